@@ -3,7 +3,37 @@
 #include <string.h>
 #include <stdio.h>
 #include "devices/ide.h"
+#include "devices/timer.h"
+#include "threads/interrupt.h"
 #include "threads/malloc.h"
+#include "threads/thread.h"
+#include "threads/workqueue.h"
+
+/* Requests that have waited this long are served before any
+   others, regardless of their position on the device. */
+#define DEADLINE_TICKS (TIMER_FREQ / 2)
+
+/* Limits on the size of a transfer made by merging requests. */
+#define MAX_MERGE_SECTORS 256
+#define MAX_MERGE_IOV 64
+
+/* Maximum number of transfers outstanding in a device's driver
+   at once. */
+#define MAX_INFLIGHT 4
+
+/* A transfer slot: a driver transfer and the requests that it
+   carries out. */
+struct xfer_slot
+  {
+    struct block_xfer xfer;             /* Passed to driver; must be first. */
+    struct block *block;                /* Device. */
+    struct list requests;               /* Requests merged into XFER. */
+    block_sector_t sector_cnt;          /* Number of sectors in XFER. */
+    struct list_elem elem;              /* Element in block's free_slots
+                                           or busy_slots. */
+    struct work work;                   /* Deferred block_complete(). */
+    struct block_iovec iov[MAX_MERGE_IOV];  /* Gathered buffers. */
+  };
 
 /* A block device. */
 struct block
@@ -19,6 +49,46 @@ struct block
 
     unsigned long long read_cnt;        /* Number of sectors read. */
     unsigned long long write_cnt;       /* Number of sectors written. */
+    unsigned long long read_req_cnt;    /* Number of read requests. */
+    unsigned long long write_req_cnt;   /* Number of write requests. */
+
+    /* Request queue, served by a dispatcher thread started at the
+       first request.  A request submitted while the device is
+       idle skips the queue: the submitter hands it to the driver
+       itself. */
+    struct lock queue_lock;             /* Protects the members below. */
+    struct condition queue_nonempty;    /* Signaled when a request arrives. */
+    struct list queue;                  /* Pending requests, by sector. */
+    size_t queue_depth;                 /* Requests queued, not dispatched. */
+    block_sector_t head_pos;            /* Sector after last dispatched. */
+    bool dispatcher_started;            /* Dispatcher thread running? */
+
+    /* Transfer slots.  Because slots are freed by block_complete(),
+       possibly in a worker thread, FREE_SLOTS and BUSY_SLOTS are
+       protected by disabling interrupts.  A slot moves to
+       BUSY_SLOTS with the queue lock held, too, so that holding
+       the lock is enough to tell that nothing new is starting. */
+    struct list free_slots;             /* Slots not in use. */
+    struct list busy_slots;             /* Slots in use by the driver. */
+    struct semaphore slot_free;         /* Number of free slots. */
+
+    /* A request that overlaps a transfer in flight is held back
+       until that transfer completes, because a driver with
+       several transfers outstanding may finish them in any
+       order.  If every queued request is held back, the
+       dispatcher sets OVERLAP_WAIT and downs OVERLAP_DONE, which
+       the next completion or submission ups.  Both are protected
+       by disabling interrupts. */
+    bool overlap_wait;                  /* Dispatcher waiting? */
+    struct semaphore overlap_done;      /* Up'd to wake dispatcher. */
+
+    unsigned long long dispatch_cnt;    /* Number of driver transfers. */
+    unsigned long long direct_cnt;      /* Transfers that skipped queue. */
+    unsigned long long merge_cnt;       /* Requests merged into others. */
+    unsigned long long depth_sum;       /* Sum of depths seen at submit. */
+    size_t depth_max;                   /* Maximum queue depth. */
+    int64_t wait_sum;                   /* Total ticks in queue. */
+    int64_t wait_max;                   /* Maximum ticks in queue. */
   };
 
 /* List of all block devices. */
@@ -28,6 +98,18 @@ static struct list all_blocks = LIST_INITIALIZER (all_blocks);
 static struct block *block_by_role[BLOCK_ROLE_CNT];
 
 static struct block *list_elem_to_block (struct list_elem *);
+static bool enter_driver (void);
+static void leave_driver (bool);
+static work_func complete_work;
+static list_less_func request_less;
+static void start_dispatcher (struct block *);
+static struct xfer_slot *claim_idle_slot (struct block *);
+static bool overlaps_busy (struct block *, block_sector_t,
+                           block_sector_t cnt);
+static void wake_overlap_wait (struct block *);
+static void load_slot (struct block *, struct xfer_slot *);
+static void start_xfer (struct block *, struct xfer_slot *);
+static thread_func dispatcher;
 
 /* Returns a human-readable name for the given block device
    TYPE. */
@@ -113,6 +195,39 @@ check_sector (struct block *block, block_sector_t sector)
     }
 }
 
+/* Returns the number of sectors covered by the IOV_CNT buffers
+   in IOV, checking that each is a whole number of sectors. */
+static block_sector_t
+iov_sector_cnt (const struct block_iovec *iov, size_t iov_cnt)
+{
+  block_sector_t cnt = 0;
+  size_t i;
+
+  for (i = 0; i < iov_cnt; i++)
+    {
+      ASSERT (iov[i].len % BLOCK_SECTOR_SIZE == 0);
+      cnt += iov[i].len / BLOCK_SECTOR_SIZE;
+    }
+  return cnt;
+}
+
+/* Verifies that the CNT sectors starting at SECTOR all lie
+   within BLOCK.  Panics if not.  Written so that no sum can
+   overflow block_sector_t, even at the end of a 2 TB device. */
+static void
+check_sectors (struct block *block, block_sector_t sector,
+               block_sector_t cnt)
+{
+  if (cnt > 0)
+    {
+      check_sector (block, sector);
+      if (cnt > block->size - sector)
+        PANIC ("Access past end of device %s (sector=%"PRDSNu", "
+               "count=%"PRDSNu", size=%"PRDSNu")\n",
+               block_name (block), sector, cnt, block->size);
+    }
+}
+
 /* Reads sector SECTOR from BLOCK into BUFFER, which must
    have room for BLOCK_SECTOR_SIZE bytes.
    Internally synchronizes accesses to block devices, so external
@@ -120,9 +235,11 @@ check_sector (struct block *block, block_sector_t sector)
 void
 block_read (struct block *block, block_sector_t sector, void *buffer)
 {
-  check_sector (block, sector);
-  block->ops->read (block->aux, sector, buffer);
-  block->read_cnt++;
+  struct block_iovec iov;
+
+  iov.base = buffer;
+  iov.len = BLOCK_SECTOR_SIZE;
+  block_read_multi (block, sector, &iov, 1);
 }
 
 /* Write sector SECTOR to BLOCK from BUFFER, which must contain
@@ -133,10 +250,455 @@ block_read (struct block *block, block_sector_t sector, void *buffer)
 void
 block_write (struct block *block, block_sector_t sector, const void *buffer)
 {
-  check_sector (block, sector);
-  ASSERT (block->type != BLOCK_FOREIGN);
-  block->ops->write (block->aux, sector, buffer);
-  block->write_cnt++;
+  struct block_iovec iov;
+
+  iov.base = (void *) buffer;
+  iov.len = BLOCK_SECTOR_SIZE;
+  block_write_multi (block, sector, &iov, 1);
+}
+
+/* Reads consecutive sectors from BLOCK, starting at SECTOR, into
+   the IOV_CNT buffers in IOV, filling each buffer in turn.  Each
+   buffer's length must be a multiple of BLOCK_SECTOR_SIZE.
+   Drivers that support it transfer several sectors per command.
+   Internally synchronizes accesses to block devices, so external
+   per-block device locking is unneeded. */
+void
+block_read_multi (struct block *block, block_sector_t sector,
+                  const struct block_iovec *iov, size_t iov_cnt)
+{
+  struct block_request r;
+
+  r.write = false;
+  r.sector = sector;
+  r.iov = iov;
+  r.iov_cnt = iov_cnt;
+  r.complete = NULL;
+  block_submit (block, &r);
+  block_wait (&r);
+}
+
+/* Writes consecutive sectors to BLOCK, starting at SECTOR, from
+   the IOV_CNT buffers in IOV, taking each buffer in turn.  Each
+   buffer's length must be a multiple of BLOCK_SECTOR_SIZE.
+   Returns after the block device has acknowledged receiving the
+   data.
+   Drivers that support it transfer several sectors per command.
+   Internally synchronizes accesses to block devices, so external
+   per-block device locking is unneeded. */
+void
+block_write_multi (struct block *block, block_sector_t sector,
+                   const struct block_iovec *iov, size_t iov_cnt)
+{
+  struct block_request r;
+
+  r.write = true;
+  r.sector = sector;
+  r.iov = iov;
+  r.iov_cnt = iov_cnt;
+  r.complete = NULL;
+  block_submit (block, &r);
+  block_wait (&r);
+}
+
+/* Queues request R, whose WRITE, SECTOR, IOV, IOV_CNT,
+   COMPLETE, and AUX members must be filled in, on BLOCK and
+   returns without waiting for it to complete.  R and the buffers
+   it refers to must remain valid until block_wait(R) returns or
+   R's completion callback is called.
+
+   If BLOCK is idle, with nothing queued and no transfer in
+   flight, R is passed to the driver from the calling thread
+   instead of going through the dispatcher thread.  If the driver
+   has no submit operation, R is then complete, and its callback
+   called, before this function returns. */
+void
+block_submit (struct block *block, struct block_request *r)
+{
+  struct xfer_slot *s;
+
+  r->sector_cnt = iov_sector_cnt (r->iov, r->iov_cnt);
+  check_sectors (block, r->sector, r->sector_cnt);
+  ASSERT (!r->write || block->type != BLOCK_FOREIGN);
+  sema_init (&r->done, 0);
+
+  lock_acquire (&block->queue_lock);
+  if (!block->dispatcher_started)
+    start_dispatcher (block);
+
+  if (r->write)
+    block->write_req_cnt++;
+  else
+    block->read_req_cnt++;
+  r->submit_time = timer_ticks ();
+  block->queue_depth++;
+  block->depth_sum += block->queue_depth;
+  if (block->queue_depth > block->depth_max)
+    block->depth_max = block->queue_depth;
+
+  if (list_empty (&block->queue) && (s = claim_idle_slot (block)) != NULL)
+    {
+      list_init (&s->requests);
+      list_push_back (&s->requests, &r->elem);
+      load_slot (block, s);
+      block->direct_cnt++;
+      lock_release (&block->queue_lock);
+      start_xfer (block, s);
+      return;
+    }
+
+  list_insert_ordered (&block->queue, &r->elem, request_less, NULL);
+  cond_signal (&block->queue_nonempty, &block->queue_lock);
+  wake_overlap_wait (block);
+  lock_release (&block->queue_lock);
+}
+
+/* Waits for request R, previously passed to block_submit() with
+   a null completion callback, to complete. */
+void
+block_wait (struct block_request *r)
+{
+  sema_down (&r->done);
+}
+
+/* Orders requests by starting sector. */
+static bool
+request_less (const struct list_elem *a_, const struct list_elem *b_,
+              void *aux UNUSED)
+{
+  const struct block_request *a = list_entry (a_, struct block_request, elem);
+  const struct block_request *b = list_entry (b_, struct block_request, elem);
+
+  return a->sector < b->sector;
+}
+
+/* Removes and returns the next request to dispatch from BLOCK's
+   queue, which must not be empty, or returns a null pointer if
+   every queued request overlaps a transfer in flight.  BLOCK's
+   queue lock must be held and interrupts must be off.
+
+   Requests are normally served in C-LOOK order: in increasing
+   order of sector from where the last one ended, wrapping
+   around to the lowest sector at the end.  A request that has
+   waited DEADLINE_TICKS or longer is served first, so that a
+   stream of requests in one part of the device cannot starve
+   the rest. */
+static struct block_request *
+next_request (struct block *block)
+{
+  int64_t now = timer_ticks ();
+  struct block_request *lowest = NULL;
+  struct block_request *oldest = NULL;
+  struct block_request *next = NULL;
+  struct list_elem *e;
+
+  ASSERT (lock_held_by_current_thread (&block->queue_lock));
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (!list_empty (&block->queue));
+
+  for (e = list_begin (&block->queue); e != list_end (&block->queue);
+       e = list_next (e))
+    {
+      struct block_request *r = list_entry (e, struct block_request, elem);
+      if (overlaps_busy (block, r->sector, r->sector_cnt))
+        continue;
+      if (lowest == NULL)
+        lowest = r;
+      if (oldest == NULL || r->submit_time < oldest->submit_time)
+        oldest = r;
+      if (next == NULL && r->sector >= block->head_pos)
+        next = r;
+    }
+
+  if (lowest == NULL)
+    return NULL;
+  if (now - oldest->submit_time >= DEADLINE_TICKS)
+    next = oldest;
+  else if (next == NULL)
+    next = lowest;
+  list_remove (&next->elem);
+  return next;
+}
+
+/* Removes from BLOCK's queue the requests that can be merged with
+   FIRST, which has already been removed, into a single transfer:
+   those in the same direction whose sectors directly follow
+   FIRST's or those of the last request merged, and that overlap
+   no transfer in flight.  Merged requests are appended to BATCH,
+   after FIRST.  BLOCK's queue lock must be held and interrupts
+   must be off. */
+static void
+merge_requests (struct block *block, struct block_request *first,
+                struct list *batch)
+{
+  block_sector_t end = first->sector + first->sector_cnt;
+  block_sector_t sector_cnt = first->sector_cnt;
+  size_t iov_cnt = first->iov_cnt;
+  struct list_elem *e;
+
+  ASSERT (lock_held_by_current_thread (&block->queue_lock));
+
+  list_push_back (batch, &first->elem);
+
+  /* The queue is sorted by sector, so any request that can follow
+     FIRST comes after it in the queue. */
+  for (e = list_begin (&block->queue); e != list_end (&block->queue); )
+    {
+      struct block_request *r = list_entry (e, struct block_request, elem);
+      if (r->sector > end)
+        break;
+      if (r->sector == end && r->write == first->write
+          && sector_cnt + r->sector_cnt <= MAX_MERGE_SECTORS
+          && iov_cnt + r->iov_cnt <= MAX_MERGE_IOV
+          && !overlaps_busy (block, r->sector, r->sector_cnt))
+        {
+          e = list_remove (e);
+          list_push_back (batch, &r->elem);
+          end += r->sector_cnt;
+          sector_cnt += r->sector_cnt;
+          iov_cnt += r->iov_cnt;
+          block->merge_cnt++;
+        }
+      else
+        e = list_next (e);
+    }
+}
+
+/* Carries out transfer X on BLOCK's driver with its synchronous
+   operations. */
+static void
+call_driver (struct block *block, const struct block_xfer *x)
+{
+  void (*multi) (void *, block_sector_t, const struct block_iovec *,
+                 size_t) = x->write ? block->ops->write_multi
+                                    : block->ops->read_multi;
+
+  if (multi != NULL)
+    multi (block->aux, x->sector, x->iov, x->iov_cnt);
+  else
+    {
+      block_sector_t sector = x->sector;
+      size_t i, ofs;
+
+      for (i = 0; i < x->iov_cnt; i++)
+        for (ofs = 0; ofs < x->iov[i].len; ofs += BLOCK_SECTOR_SIZE)
+          {
+            uint8_t *buffer = (uint8_t *) x->iov[i].base + ofs;
+            if (x->write)
+              block->ops->write (block->aux, sector++, buffer);
+            else
+              block->ops->read (block->aux, sector++, buffer);
+          }
+    }
+}
+
+/* Starts BLOCK's dispatcher thread and sets up its transfer
+   slots.  BLOCK's queue lock must be held. */
+static void
+start_dispatcher (struct block *block)
+{
+  struct xfer_slot *slots;
+  char name[sizeof block->name + 3];
+  size_t i;
+
+  ASSERT (lock_held_by_current_thread (&block->queue_lock));
+
+  slots = malloc (MAX_INFLIGHT * sizeof *slots);
+  if (slots == NULL)
+    PANIC ("%s: couldn't allocate transfer slots", block->name);
+  for (i = 0; i < MAX_INFLIGHT; i++)
+    {
+      slots[i].block = block;
+      work_init (&slots[i].work, complete_work, &slots[i]);
+      list_push_back (&block->free_slots, &slots[i].elem);
+      sema_up (&block->slot_free);
+    }
+
+  snprintf (name, sizeof name, "%s-io", block->name);
+  if (thread_create (name, PRI_DEFAULT, dispatcher, block) == TID_ERROR)
+    PANIC ("%s: couldn't start I/O dispatcher", block->name);
+  block->dispatcher_started = true;
+}
+
+/* Returns a free transfer slot on BLOCK if no transfer is in
+   flight there, otherwise a null pointer.  BLOCK's queue lock
+   must be held. */
+static struct xfer_slot *
+claim_idle_slot (struct block *block)
+{
+  struct xfer_slot *s = NULL;
+  enum intr_level old_level;
+
+  ASSERT (lock_held_by_current_thread (&block->queue_lock));
+
+  old_level = intr_disable ();
+  if (list_empty (&block->busy_slots) && sema_try_down (&block->slot_free))
+    s = list_entry (list_pop_front (&block->free_slots),
+                    struct xfer_slot, elem);
+  intr_set_level (old_level);
+  return s;
+}
+
+/* Returns true if any of the CNT sectors starting at SECTOR is
+   part of a transfer in flight on BLOCK.  Interrupts must be
+   off. */
+static bool
+overlaps_busy (struct block *block, block_sector_t sector,
+               block_sector_t cnt)
+{
+  struct list_elem *e;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  for (e = list_begin (&block->busy_slots); e != list_end (&block->busy_slots);
+       e = list_next (e))
+    {
+      struct xfer_slot *s = list_entry (e, struct xfer_slot, elem);
+      if (sector < s->xfer.sector + s->sector_cnt
+          && s->xfer.sector < sector + cnt)
+        return true;
+    }
+  return false;
+}
+
+/* Wakes up BLOCK's dispatcher if it is waiting for a transfer in
+   flight to complete before it can dispatch anything. */
+static void
+wake_overlap_wait (struct block *block)
+{
+  enum intr_level old_level = intr_disable ();
+  if (block->overlap_wait)
+    {
+      block->overlap_wait = false;
+      sema_up (&block->overlap_done);
+    }
+  intr_set_level (old_level);
+}
+
+/* Fills in slot S's transfer from the requests on its REQUESTS
+   list, which must be consecutive and in the same direction, and
+   marks S busy.  BLOCK's queue lock must be held. */
+static void
+load_slot (struct block *block, struct xfer_slot *s)
+{
+  struct block_request *first = list_entry (list_front (&s->requests),
+                                            struct block_request, elem);
+  enum intr_level old_level;
+  struct list_elem *e;
+  int64_t now;
+  size_t i;
+
+  ASSERT (lock_held_by_current_thread (&block->queue_lock));
+
+  now = timer_ticks ();
+  s->sector_cnt = 0;
+  s->xfer.iov_cnt = 0;
+  for (e = list_begin (&s->requests); e != list_end (&s->requests);
+       e = list_next (e))
+    {
+      struct block_request *r = list_entry (e, struct block_request, elem);
+      int64_t wait = now - r->submit_time;
+      block->queue_depth--;
+      block->wait_sum += wait;
+      if (wait > block->wait_max)
+        block->wait_max = wait;
+      s->sector_cnt += r->sector_cnt;
+      s->xfer.iov_cnt += r->iov_cnt;
+    }
+  block->head_pos = first->sector + s->sector_cnt;
+  block->dispatch_cnt++;
+
+  /* Gather the requests' buffers into one list. */
+  s->xfer.write = first->write;
+  s->xfer.sector = first->sector;
+  if (list_front (&s->requests) == list_back (&s->requests))
+    s->xfer.iov = first->iov;
+  else
+    {
+      i = 0;
+      for (e = list_begin (&s->requests); e != list_end (&s->requests);
+           e = list_next (e))
+        {
+          struct block_request *r = list_entry (e, struct block_request,
+                                                elem);
+          memcpy (&s->iov[i], r->iov, r->iov_cnt * sizeof *s->iov);
+          i += r->iov_cnt;
+        }
+      s->xfer.iov = s->iov;
+    }
+
+  old_level = intr_disable ();
+  list_push_back (&block->busy_slots, &s->elem);
+  intr_set_level (old_level);
+}
+
+/* Passes slot S's transfer to BLOCK's driver. */
+static void
+start_xfer (struct block *block, struct xfer_slot *s)
+{
+  bool old_io = enter_driver ();
+  if (block->ops->submit != NULL)
+    block->ops->submit (block->aux, &s->xfer);
+  else
+    {
+      call_driver (block, &s->xfer);
+      block_complete (&s->xfer);
+    }
+  leave_driver (old_io);
+}
+
+/* I/O dispatcher thread for block device BLOCK_.  Takes requests
+   off the device's queue in elevator order, merges adjacent ones
+   into single transfers, and passes them to the driver.  Up to
+   MAX_INFLIGHT transfers may be outstanding at once if the
+   driver can complete them asynchronously. */
+static void
+dispatcher (void *block_)
+{
+  struct block *block = block_;
+
+  for (;;)
+    {
+      struct xfer_slot *s;
+      struct block_request *first;
+      enum intr_level old_level;
+
+      /* Wait for a free slot. */
+      sema_down (&block->slot_free);
+      old_level = intr_disable ();
+      s = list_entry (list_pop_front (&block->free_slots),
+                      struct xfer_slot, elem);
+      intr_set_level (old_level);
+
+      /* Pick the next batch of requests. */
+      lock_acquire (&block->queue_lock);
+      list_init (&s->requests);
+      for (;;)
+        {
+          while (list_empty (&block->queue))
+            cond_wait (&block->queue_nonempty, &block->queue_lock);
+
+          old_level = intr_disable ();
+          first = next_request (block);
+          if (first != NULL)
+            {
+              merge_requests (block, first, &s->requests);
+              intr_set_level (old_level);
+              break;
+            }
+
+          /* Everything queued overlaps a transfer in flight. */
+          block->overlap_wait = true;
+          lock_release (&block->queue_lock);
+          sema_down (&block->overlap_done);
+          intr_set_level (old_level);
+          lock_acquire (&block->queue_lock);
+        }
+      load_slot (block, s);
+      lock_release (&block->queue_lock);
+
+      start_xfer (block, s);
+    }
 }
 
 /* Returns the number of sectors in BLOCK. */
@@ -171,9 +733,35 @@ block_print_stats (void)
       struct block *block = block_by_role[i];
       if (block != NULL)
         {
-          printf ("%s (%s): %llu reads, %llu writes\n",
+          unsigned long long req_cnt = (block->read_req_cnt
+                                        + block->write_req_cnt);
+          unsigned long long avg = (req_cnt > 0
+                                    ? ((block->read_cnt + block->write_cnt)
+                                       * 10 / req_cnt)
+                                    : 0);
+
+          printf ("%s (%s): %llu reads in %llu requests, "
+                  "%llu writes in %llu requests, "
+                  "%llu.%llu sectors/request\n",
                   block->name, block_type_name (block->type),
-                  block->read_cnt, block->write_cnt);
+                  block->read_cnt, block->read_req_cnt,
+                  block->write_cnt, block->write_req_cnt,
+                  avg / 10, avg % 10);
+          if (req_cnt > 0)
+            {
+              unsigned long long depth = block->depth_sum * 10 / req_cnt;
+              long long wait = block->wait_sum * 10 / req_cnt;
+
+              printf ("%s (%s): %llu transfers (%llu direct), "
+                      "%llu requests merged, "
+                      "queue depth %llu.%llu avg %zu max, "
+                      "wait %lld.%lld avg %lld max ticks\n",
+                      block->name, block_type_name (block->type),
+                      block->dispatch_cnt, block->direct_cnt,
+                      block->merge_cnt,
+                      depth / 10, depth % 10, block->depth_max,
+                      wait / 10, wait % 10, (long long) block->wait_max);
+            }
         }
     }
 }
@@ -200,6 +788,26 @@ block_register (const char *name, enum block_type type,
   block->aux = aux;
   block->read_cnt = 0;
   block->write_cnt = 0;
+  block->read_req_cnt = 0;
+  block->write_req_cnt = 0;
+  lock_init (&block->queue_lock);
+  cond_init (&block->queue_nonempty);
+  list_init (&block->queue);
+  block->queue_depth = 0;
+  block->head_pos = 0;
+  block->dispatcher_started = false;
+  list_init (&block->free_slots);
+  list_init (&block->busy_slots);
+  sema_init (&block->slot_free, 0);
+  block->overlap_wait = false;
+  sema_init (&block->overlap_done, 0);
+  block->dispatch_cnt = 0;
+  block->direct_cnt = 0;
+  block->merge_cnt = 0;
+  block->depth_sum = 0;
+  block->depth_max = 0;
+  block->wait_sum = 0;
+  block->wait_max = 0;
 
   printf ("%s: %'"PRDSNu" sectors (", block->name, block->size);
   print_human_readable_size ((uint64_t) block->size * BLOCK_SECTOR_SIZE);
@@ -211,6 +819,61 @@ block_register (const char *name, enum block_type type,
   return block;
 }
 
+/* Called by a block device driver when transfer X, passed to its
+   submit operation, is done.  Completes the requests that the
+   transfer carried out, calling their completion callbacks or
+   waking up their submitters.  May be called from an interrupt
+   handler, in which case the work is handed off to a worker
+   thread. */
+void
+block_complete (struct block_xfer *x)
+{
+  struct xfer_slot *s = (struct xfer_slot *) x;
+  struct block *block = s->block;
+  enum intr_level old_level;
+
+  if (intr_context ())
+    {
+      work_queue (&s->work, WORK_HIGH);
+      return;
+    }
+
+  /* The slot's requests belong to us until the slot is freed, so
+     interrupts only need to be off while each one is completed. */
+  while (!list_empty (&s->requests))
+    {
+      struct block_request *r = list_entry (list_pop_front (&s->requests),
+                                            struct block_request, elem);
+      old_level = intr_disable ();
+      if (r->complete != NULL)
+        r->complete (r, r->aux);
+      else
+        sema_up (&r->done);
+      intr_set_level (old_level);
+    }
+
+  old_level = intr_disable ();
+  if (x->write)
+    block->write_cnt += s->sector_cnt;
+  else
+    block->read_cnt += s->sector_cnt;
+  list_remove (&s->elem);
+  list_push_back (&block->free_slots, &s->elem);
+  sema_up (&block->slot_free);
+  wake_overlap_wait (block);
+  intr_set_level (old_level);
+}
+
+/* Worker thread function that runs block_complete() for the
+   transfer slot S_, after a driver called it from an interrupt
+   handler. */
+static void
+complete_work (struct work *w UNUSED, void *s_) 
+{
+  struct xfer_slot *s = s_;
+  block_complete (&s->xfer);
+}
+
 /* Returns the block device corresponding to LIST_ELEM, or a null
    pointer if LIST_ELEM is the list end of all_blocks. */
 static struct block *
@@ -221,3 +884,25 @@ list_elem_to_block (struct list_elem *list_elem)
           : NULL);
 }
 
+
+/* Marks the running thread as executing in a block device
+   driver, so that thread_tick() can count the CPU time spent
+   moving data, and returns its previous state.  A driver that
+   sleeps until its device finishes, as with DMA, is not charged
+   for the time it sleeps. */
+static bool
+enter_driver (void)
+{
+  struct thread *t = thread_current ();
+  bool old = t->in_block_io;
+  t->in_block_io = true;
+  return old;
+}
+
+/* Restores the running thread's block driver state to OLD, as
+   returned by enter_driver(). */
+static void
+leave_driver (bool old)
+{
+  thread_current ()->in_block_io = old;
+}
@@ -1,8 +1,11 @@
 #ifndef DEVICES_BLOCK_H
 #define DEVICES_BLOCK_H
 
+#include <list.h>
+#include <stdbool.h>
 #include <stddef.h>
 #include <inttypes.h>
+#include "threads/synch.h"
 
 /* Size of a block device sector in bytes.
    All IDE disks use this sector size, as do most USB and SCSI
@@ -22,6 +25,14 @@ typedef uint32_t block_sector_t;
 
 struct block;
 
+/* One buffer in a multi-sector transfer, in the style of
+   struct iovec.  LEN must be a multiple of BLOCK_SECTOR_SIZE. */
+struct block_iovec
+  {
+    void *base;                 /* Start of buffer. */
+    size_t len;                 /* Length in bytes. */
+  };
+
 /* Type of a block device. */
 enum block_type
   {
@@ -53,22 +64,92 @@ struct block *block_next (struct block *);
 block_sector_t block_size (struct block *);
 void block_read (struct block *, block_sector_t, void *);
 void block_write (struct block *, block_sector_t, const void *);
+void block_read_multi (struct block *, block_sector_t,
+                       const struct block_iovec *, size_t iov_cnt);
+void block_write_multi (struct block *, block_sector_t,
+                        const struct block_iovec *, size_t iov_cnt);
 const char *block_name (struct block *);
 enum block_type block_type (struct block *);
 
+/* Asynchronous I/O. */
+
+struct block_request;
+
+/* Called when an asynchronous request completes.  Runs with
+   interrupts off, so it must not sleep. */
+typedef void block_complete_func (struct block_request *, void *aux);
+
+/* A request to transfer consecutive sectors to or from a block
+   device, for use with block_submit() and block_wait().
+
+   If COMPLETE is null, the submitter learns of completion by
+   calling block_wait().  Otherwise, COMPLETE is called with AUX
+   instead and block_wait() must not be used. */
+struct block_request
+  {
+    /* Filled in by the submitter. */
+    bool write;                         /* True to write, false to read. */
+    block_sector_t sector;              /* First sector. */
+    const struct block_iovec *iov;      /* Buffers. */
+    size_t iov_cnt;                     /* Number of buffers. */
+    block_complete_func *complete;      /* Completion callback or null. */
+    void *aux;                          /* Passed to COMPLETE. */
+
+    /* Owned by devices/block.c. */
+    struct list_elem elem;              /* Element in device queue. */
+    block_sector_t sector_cnt;          /* Number of sectors. */
+    int64_t submit_time;                /* Timer tick when submitted. */
+    struct semaphore done;              /* Up'd when complete. */
+  };
+
+void block_submit (struct block *, struct block_request *);
+void block_wait (struct block_request *);
+
 /* Statistics. */
 void block_print_stats (void);
 
 /* Lower-level interface to block device drivers. */
 
+/* A transfer of consecutive sectors handed by the block layer
+   to a driver's submit operation. */
+struct block_xfer
+  {
+    bool write;                         /* True to write, false to read. */
+    block_sector_t sector;              /* First sector. */
+    const struct block_iovec *iov;      /* Buffers. */
+    size_t iov_cnt;                     /* Number of buffers. */
+
+    /* For use by a driver that passes the transfer on to another
+       block device, such as a partition. */
+    struct block_request lower;
+  };
+
 struct block_operations
   {
     void (*read) (void *aux, block_sector_t, void *buffer);
     void (*write) (void *aux, block_sector_t, const void *buffer);
+
+    /* Optional.  Transfer consecutive sectors, starting at the
+       given one, to or from the IOV_CNT buffers in IOV.  A
+       driver that can move several sectors per command should
+       provide these.  If they are null, the block layer calls
+       READ or WRITE once per sector instead. */
+    void (*read_multi) (void *aux, block_sector_t,
+                        const struct block_iovec *iov, size_t iov_cnt);
+    void (*write_multi) (void *aux, block_sector_t,
+                         const struct block_iovec *iov, size_t iov_cnt);
+
+    /* Optional.  Starts transfer XFER and returns, possibly
+       before the transfer is done.  The driver must call
+       block_complete(XFER) when it finishes, from an interrupt
+       handler if it likes.  If this is null, the block layer
+       uses the synchronous operations above. */
+    void (*submit) (void *aux, struct block_xfer *xfer);
   };
 
 struct block *block_register (const char *name, enum block_type,
                               const char *extra_info, block_sector_t size,
                               const struct block_operations *, void *aux);
+void block_complete (struct block_xfer *);
 
 #endif /* devices/block.h */
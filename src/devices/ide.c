@@ -3,15 +3,30 @@
 #include <debug.h>
 #include <stdbool.h>
 #include <stdio.h>
+#include <string.h>
 #include "devices/block.h"
 #include "devices/partition.h"
+#include "devices/pci.h"
 #include "devices/timer.h"
 #include "threads/io.h"
 #include "threads/interrupt.h"
+#include "threads/palloc.h"
 #include "threads/synch.h"
+#include "threads/vaddr.h"
 
 /* The code in this file is an interface to an ATA (IDE)
-   controller.  It attempts to comply to [ATA-3]. */
+   controller.  It attempts to comply to [ATA-3].
+
+   If the controller is a PCI bus-master IDE controller, such as
+   the PIIX emulated by QEMU and Bochs, data is transferred by DMA
+   [SFF-8038i]: the driver gives the controller a table of
+   physical memory regions and the issuing thread sleeps until
+   the transfer completes.  Otherwise, or if a buffer can't be
+   used for DMA, the CPU moves the data itself with PIO.
+
+   A DMA transfer started by the block layer's dispatcher through
+   ide_submit() does not make it sleep: the interrupt handler
+   finishes the transfer and calls block_complete(). */
 
 /* ATA command block port addresses. */
 #define reg_data(CHANNEL) ((CHANNEL)->reg_base + 0)     /* Data. */
@@ -30,10 +45,37 @@
 #define reg_ctl(CHANNEL) ((CHANNEL)->reg_base + 0x206)  /* Control (w/o). */
 #define reg_alt_status(CHANNEL) reg_ctl (CHANNEL)       /* Alt Status (r/o). */
 
+/* Bus master IDE port addresses, relative to the channel's
+   bus master base. */
+#define reg_bm_command(CHANNEL) ((CHANNEL)->bm_base + 0) /* Command. */
+#define reg_bm_status(CHANNEL) ((CHANNEL)->bm_base + 2)  /* Status. */
+#define reg_bm_prdt(CHANNEL) ((CHANNEL)->bm_base + 4)    /* PRDT address. */
+
+/* Bus master Command Register bits. */
+#define BMC_START 0x01          /* Start transfer. */
+#define BMC_READ 0x08           /* 1=device to memory, 0=memory to device. */
+
+/* Bus master Status Register bits. */
+#define BMS_ERR 0x02            /* Transfer failed (write 1 to clear). */
+#define BMS_INTR 0x04           /* Device interrupted (write 1 to clear). */
+
+/* Physical region descriptor: one contiguous region of physical
+   memory in a DMA transfer.  A region may not cross a 64 kB
+   boundary. */
+struct prd
+  {
+    uint32_t addr;              /* Physical address, even. */
+    uint16_t size;              /* Size in bytes, even; 0 means 64 kB. */
+    uint16_t flags;             /* PRD_EOT in last descriptor. */
+  };
+#define PRD_EOT 0x8000          /* End of table. */
+#define PRD_CNT (PGSIZE / sizeof (struct prd))
+
 /* Alternate Status Register bits. */
 #define STA_BSY 0x80            /* Busy. */
 #define STA_DRDY 0x40           /* Device Ready. */
 #define STA_DRQ 0x08            /* Data Request. */
+#define STA_ERR 0x01            /* Error. */
 
 /* Control Register bits. */
 #define CTL_SRST 0x04           /* Software Reset. */
@@ -49,6 +91,26 @@
 #define CMD_IDENTIFY_DEVICE 0xec        /* IDENTIFY DEVICE. */
 #define CMD_READ_SECTOR_RETRY 0x20      /* READ SECTOR with retries. */
 #define CMD_WRITE_SECTOR_RETRY 0x30     /* WRITE SECTOR with retries. */
+#define CMD_READ_MULTIPLE 0xc4          /* READ MULTIPLE. */
+#define CMD_WRITE_MULTIPLE 0xc5         /* WRITE MULTIPLE. */
+#define CMD_SET_MULTIPLE_MODE 0xc6      /* SET MULTIPLE MODE. */
+#define CMD_READ_DMA 0xc8               /* READ DMA. */
+#define CMD_WRITE_DMA 0xca              /* WRITE DMA. */
+
+/* 48-bit LBA variants of the commands above [ATA-6], needed to
+   address sectors beyond the first 2**28 (128 GB). */
+#define CMD_READ_SECTORS_EXT 0x24       /* READ SECTORS EXT. */
+#define CMD_WRITE_SECTORS_EXT 0x34      /* WRITE SECTORS EXT. */
+#define CMD_READ_MULTIPLE_EXT 0x29      /* READ MULTIPLE EXT. */
+#define CMD_WRITE_MULTIPLE_EXT 0x39     /* WRITE MULTIPLE EXT. */
+#define CMD_READ_DMA_EXT 0x25           /* READ DMA EXT. */
+#define CMD_WRITE_DMA_EXT 0x35          /* WRITE DMA EXT. */
+
+/* Sectors addressable with 28-bit LBA. */
+#define LBA28_SECTORS (1UL << 28)
+
+/* Maximum number of sectors in a single command. */
+#define MAX_SECTORS_PER_CMD 256
 
 /* An ATA device. */
 struct ata_disk
@@ -57,6 +119,10 @@ struct ata_disk
     struct channel *channel;    /* Channel that disk is attached to. */
     int dev_no;                 /* Device 0 or 1 for master or slave. */
     bool is_ata;                /* Is device an ATA disk? */
+    int multiple;               /* Sectors per interrupt for READ/WRITE
+                                   MULTIPLE, or 0 if not enabled. */
+    bool dma;                   /* Use DMA for transfers? */
+    bool lba48;                 /* Supports 48-bit LBA? */
   };
 
 /* An ATA channel (aka controller).
@@ -67,11 +133,24 @@ struct channel
     uint16_t reg_base;          /* Base I/O port. */
     uint8_t irq;                /* Interrupt in use. */
 
-    struct lock lock;           /* Must acquire to access the controller. */
+    struct semaphore access;    /* Must down to access the controller.
+                                   Up'd by the interrupt handler at
+                                   the end of an asynchronous
+                                   transfer, which is why this is
+                                   not a lock: the thread that
+                                   starts the transfer is not the
+                                   one that finishes it, and an
+                                   interrupt handler cannot hold a
+                                   lock. */
     bool expecting_interrupt;   /* True if an interrupt is expected, false if
                                    any interrupt would be spurious. */
     struct semaphore completion_wait;   /* Up'd by interrupt handler. */
 
+    uint16_t bm_base;           /* Bus master base I/O port, or 0. */
+    struct prd *prdt;           /* Physical region descriptor table. */
+    struct block_xfer *xfer;    /* Asynchronous transfer in progress. */
+    struct ata_disk *xfer_disk; /* Disk that XFER is on. */
+
     struct ata_disk devices[2];     /* The devices on this channel. */
   };
 
@@ -81,11 +160,26 @@ static struct channel channels[CHANNEL_CNT];
 
 static struct block_operations ide_operations;
 
+/* If true, use PIO even when DMA is available.
+   Controlled by kernel command-line option "-pio". */
+bool ide_pio_only;
+
+static void find_bus_master (void);
 static void reset_channel (struct channel *);
 static bool check_device_type (struct ata_disk *);
 static void identify_ata_device (struct ata_disk *);
 
-static void select_sector (struct ata_disk *, block_sector_t);
+static void set_multiple_mode (struct ata_disk *, int sectors);
+
+struct iov_cursor;
+static bool dma_start (struct ata_disk *, block_sector_t, int cnt,
+                       struct iov_cursor *, bool write);
+static void dma_finish (struct ata_disk *, block_sector_t, bool write);
+static bool dma_transfer (struct ata_disk *, block_sector_t, int cnt,
+                          struct iov_cursor *, bool write);
+
+static bool is_emulated_disk (const char *model);
+static bool select_sector (struct ata_disk *, block_sector_t, int cnt);
 static void issue_pio_command (struct channel *, uint8_t command);
 static void input_sector (struct channel *, void *);
 static void output_sector (struct channel *, const void *);
@@ -103,6 +197,7 @@ ide_init (void)
 {
   size_t chan_no;
 
+  find_bus_master ();
   for (chan_no = 0; chan_no < CHANNEL_CNT; chan_no++)
     {
       struct channel *c = &channels[chan_no];
@@ -123,7 +218,7 @@ ide_init (void)
         default:
           NOT_REACHED ();
         }
-      lock_init (&c->lock);
+      sema_init (&c->access, 1);
       c->expecting_interrupt = false;
       sema_init (&c->completion_wait, 0);
  
@@ -136,6 +231,9 @@ ide_init (void)
           d->channel = c;
           d->dev_no = dev_no;
           d->is_ata = false;
+          d->multiple = 0;
+          d->dma = false;
+          d->lba48 = false;
         }
 
       /* Register interrupt handler. */
@@ -157,6 +255,51 @@ ide_init (void)
 
 /* Disk detection and identification. */
 
+/* Looks for a PCI bus-master IDE controller driving the legacy
+   channels and, if there is one, sets up each channel for DMA. */
+static void
+find_bus_master (void) 
+{
+  struct pci_addr addr;
+  uint32_t class_reg, bar4, cmd;
+  uint8_t prog_if;
+  size_t chan_no;
+
+  /* Mass storage controller, IDE interface. */
+  if (!pci_find_class (0x01, 0x01, &addr))
+    return;
+
+  /* Programming interface bit 7 says the controller can be a bus
+     master.  Bits 0 and 2 are set if channel 0 or 1 is in PCI
+     native mode, using ports other than the legacy ones that we
+     use. */
+  class_reg = pci_read_config (&addr, PCI_REG_CLASS);
+  prog_if = class_reg >> 8;
+  if ((prog_if & 0x80) == 0 || (prog_if & 0x05) != 0)
+    return;
+
+  /* BAR4 holds the bus master registers in I/O space. */
+  bar4 = pci_read_config (&addr, PCI_REG_BAR0 + 4 * 4);
+  if ((bar4 & 1) == 0 || (bar4 & 0xfffc) == 0)
+    return;
+
+  for (chan_no = 0; chan_no < CHANNEL_CNT; chan_no++)
+    {
+      struct channel *c = &channels[chan_no];
+      c->prdt = palloc_get_page (0);
+      if (c->prdt == NULL)
+        return;
+      c->bm_base = (bar4 & 0xfffc) + chan_no * 8;
+    }
+
+  /* Enable I/O decoding and bus mastering.  Writing zeros to the
+     status half of the register leaves it unchanged. */
+  cmd = pci_read_config (&addr, PCI_REG_CMD) & 0xffff;
+  pci_write_config (&addr, PCI_REG_CMD, cmd | PCI_CMD_IO | PCI_CMD_MASTER);
+
+  printf ("ide: bus master DMA at I/O port 0x%04"PRIx32"\n", bar4 & 0xfffc);
+}
+
 static char *descramble_ata_string (char *, int size);
 
 /* Resets an ATA channel and waits for any devices present on it
@@ -261,7 +404,7 @@ identify_ata_device (struct ata_disk *d)
 {
   struct channel *c = d->channel;
   char id[BLOCK_SECTOR_SIZE];
-  block_sector_t capacity;
+  uint64_t capacity;
   char *model, *serial;
   char extra_info[128];
   struct block *block;
@@ -281,20 +424,29 @@ identify_ata_device (struct ata_disk *d)
     }
   input_sector (c, id);
 
-  /* Calculate capacity.
+  /* Calculate capacity.  If word 83 bit 10 says that the disk
+     supports 48-bit LBA, words 100 through 103 give its full
+     capacity; otherwise, words 60 and 61 give the number of
+     sectors addressable with 28-bit LBA.
      Read model name and serial number. */
-  capacity = *(uint32_t *) &id[60 * 2];
+  d->lba48 = (*(uint16_t *) &id[83 * 2] & 0x0400) != 0;
+  if (d->lba48)
+    capacity = *(uint64_t *) &id[100 * 2];
+  else
+    capacity = *(uint32_t *) &id[60 * 2];
   model = descramble_ata_string (&id[10 * 2], 20);
   serial = descramble_ata_string (&id[27 * 2], 40);
   snprintf (extra_info, sizeof extra_info,
             "model \"%s\", serial \"%s\"", model, serial);
 
   /* Disable access to IDE disks over 1 GB, which are likely
-     physical IDE disks rather than virtual ones.  If we don't
-     allow access to those, we're less likely to scribble on
-     someone's important data.  You can disable this check by
-     hand if you really want to do so. */
-  if (capacity >= 1024 * 1024 * 1024 / BLOCK_SECTOR_SIZE)
+     physical IDE disks rather than virtual ones, unless the model
+     name shows that the disk is emulated.  If we don't allow
+     access to those, we're less likely to scribble on someone's
+     important data.  You can disable this check by hand if you
+     really want to do so. */
+  if (capacity >= 1024 * 1024 * 1024 / BLOCK_SECTOR_SIZE
+      && !is_emulated_disk (model))
     {
       printf ("%s: ignoring ", d->name);
       print_human_readable_size (capacity * 512);
@@ -303,12 +455,69 @@ identify_ata_device (struct ata_disk *d)
       return;
     }
 
+  /* Sector numbers are 32 bits, so we can only use the first 2 TB
+     of a larger disk. */
+  if (capacity > (block_sector_t) -1)
+    {
+      printf ("%s: using only the first 2 TB of ", d->name);
+      print_human_readable_size (capacity * 512);
+      printf (" disk\n");
+      capacity = (block_sector_t) -1;
+    }
+
+  /* Enable READ/WRITE MULTIPLE if the disk supports it.  Word
+     47 bits 7:0 give the most sectors it can transfer per
+     interrupt. */
+  if ((id[47 * 2] & 0xff) > 1)
+    set_multiple_mode (d, id[47 * 2] & 0xff);
+
+  /* Use DMA if the channel has a bus master and word 49 bit 8
+     says the disk supports DMA. */
+  d->dma = (!ide_pio_only && c->bm_base != 0
+            && (*(uint16_t *) &id[49 * 2] & 0x0100) != 0);
+
   /* Register. */
   block = block_register (d->name, BLOCK_RAW, extra_info, capacity,
                           &ide_operations, d);
   partition_scan (block);
 }
 
+/* Returns true if MODEL is the model name of a disk emulated by
+   QEMU or Bochs. */
+static bool
+is_emulated_disk (const char *model) 
+{
+  static const char *models[] = {"QEMU HARDDISK", "Generic 1234", "BXHD"};
+  size_t i;
+
+  for (i = 0; i < sizeof models / sizeof *models; i++)
+    {
+      size_t len = strlen (models[i]);
+      if (strlen (model) >= len && !memcmp (model, models[i], len))
+        return true;
+    }
+  return false;
+}
+
+/* Sends a SET MULTIPLE MODE command to disk D, asking it to
+   transfer SECTORS sectors per interrupt in READ MULTIPLE and
+   WRITE MULTIPLE commands.  On success, sets D's multiple
+   member; otherwise, leaves it 0, so that single-sector
+   commands are used. */
+static void
+set_multiple_mode (struct ata_disk *d, int sectors) 
+{
+  struct channel *c = d->channel;
+
+  select_device_wait (d);
+  outb (reg_nsect (c), sectors);
+  issue_pio_command (c, CMD_SET_MULTIPLE_MODE);
+  sema_down (&c->completion_wait);
+  wait_while_busy (d);
+  if ((inb (reg_status (c)) & STA_ERR) == 0)
+    d->multiple = sectors;
+}
+
 /* Translates STRING, which consists of SIZE bytes in a funky
    format, into a null-terminated string in-place.  Drops
    trailing whitespace and null bytes.  Returns STRING.  */
@@ -337,6 +546,282 @@ descramble_ata_string (char *string, int size)
   return string;
 }
 
+/* Position within the list of buffers of a multi-sector
+   transfer. */
+struct iov_cursor
+  {
+    const struct block_iovec *iov;      /* Current buffer. */
+    size_t ofs;                         /* Offset within buffer. */
+  };
+
+/* Returns the sector at CUR and advances CUR to the next one. */
+static uint8_t *
+iov_next_sector (struct iov_cursor *cur) 
+{
+  uint8_t *sector;
+
+  while (cur->ofs >= cur->iov->len) 
+    {
+      cur->iov++;
+      cur->ofs = 0;
+    }
+  sector = (uint8_t *) cur->iov->base + cur->ofs;
+  cur->ofs += BLOCK_SECTOR_SIZE;
+  return sector;
+}
+
+/* Reads CNT sectors, at most MAX_SECTORS_PER_CMD, starting at
+   SEC_NO from disk D into the buffers at CUR, with a single
+   command.  The caller must have downed D's channel's access
+   semaphore.
+
+   With READ MULTIPLE, the disk interrupts once per d->multiple
+   sectors; otherwise, READ SECTOR interrupts once per
+   sector. */
+static void
+read_sectors (struct ata_disk *d, block_sector_t sec_no, int cnt,
+              struct iov_cursor *cur) 
+{
+  struct channel *c = d->channel;
+  int per_intr = d->multiple > 0 ? d->multiple : 1;
+
+  ASSERT (cnt > 0 && cnt <= MAX_SECTORS_PER_CMD);
+
+  if (d->dma && dma_transfer (d, sec_no, cnt, cur, false))
+    return;
+
+  if (!select_sector (d, sec_no, cnt))
+    issue_pio_command (c, (d->multiple > 0
+                           ? CMD_READ_MULTIPLE : CMD_READ_SECTOR_RETRY));
+  else
+    issue_pio_command (c, (d->multiple > 0
+                           ? CMD_READ_MULTIPLE_EXT : CMD_READ_SECTORS_EXT));
+  while (cnt > 0) 
+    {
+      int i;
+
+      sema_down (&c->completion_wait);
+      if (!wait_while_busy (d))
+        PANIC ("%s: disk read failed, sector=%"PRDSNu, d->name, sec_no);
+      for (i = 0; i < per_intr && cnt > 0; i++, cnt--, sec_no++)
+        input_sector (c, iov_next_sector (cur));
+    }
+}
+
+/* Writes CNT sectors, at most MAX_SECTORS_PER_CMD, starting at
+   SEC_NO to disk D from the buffers at CUR, with a single
+   command.  Returns after the disk has acknowledged receiving
+   the data.  The caller must have downed D's channel's access
+   semaphore. */
+static void
+write_sectors (struct ata_disk *d, block_sector_t sec_no, int cnt,
+               struct iov_cursor *cur) 
+{
+  struct channel *c = d->channel;
+  int per_intr = d->multiple > 0 ? d->multiple : 1;
+
+  ASSERT (cnt > 0 && cnt <= MAX_SECTORS_PER_CMD);
+
+  if (d->dma && dma_transfer (d, sec_no, cnt, cur, true))
+    return;
+
+  if (!select_sector (d, sec_no, cnt))
+    issue_pio_command (c, (d->multiple > 0
+                           ? CMD_WRITE_MULTIPLE : CMD_WRITE_SECTOR_RETRY));
+  else
+    issue_pio_command (c, (d->multiple > 0
+                           ? CMD_WRITE_MULTIPLE_EXT : CMD_WRITE_SECTORS_EXT));
+  while (cnt > 0) 
+    {
+      int i;
+
+      if (!wait_while_busy (d))
+        PANIC ("%s: disk write failed, sector=%"PRDSNu, d->name, sec_no);
+      for (i = 0; i < per_intr && cnt > 0; i++, cnt--, sec_no++)
+        output_sector (c, iov_next_sector (cur));
+      sema_down (&c->completion_wait);
+    }
+}
+
+/* Appends the SIZE bytes of physical memory at PADDR to the
+   *PRD_CNT entries in PRDT, merging with the last entry when
+   they are adjacent and splitting at 64 kB boundaries.  Returns
+   false if the table is full. */
+static bool
+add_prd (struct prd *prdt, size_t *prd_cnt, uint32_t paddr, uint32_t size) 
+{
+  while (size > 0) 
+    {
+      uint32_t boundary = (paddr | 0xffff) + 1;
+      uint32_t chunk = boundary - paddr < size ? boundary - paddr : size;
+      struct prd *last = *prd_cnt > 0 ? &prdt[*prd_cnt - 1] : NULL;
+      uint32_t last_size = (last != NULL && last->size == 0
+                            ? 0x10000 : last != NULL ? last->size : 0);
+
+      if (last != NULL && last->addr + last_size == paddr
+          && (last->addr & ~0xffff) == (paddr & ~0xffff))
+        last->size = (last_size + chunk) & 0xffff;
+      else if (*prd_cnt < PRD_CNT)
+        {
+          last = &prdt[(*prd_cnt)++];
+          last->addr = paddr;
+          last->size = chunk & 0xffff;
+          last->flags = 0;
+        }
+      else
+        return false;
+
+      paddr += chunk;
+      size -= chunk;
+    }
+  return true;
+}
+
+/* Starts a DMA transfer of CNT sectors, at most
+   MAX_SECTORS_PER_CMD, starting at SEC_NO between disk D and the
+   buffers at CUR, reading from the disk if WRITE is false,
+   writing if it is true.  The disk interrupts when the transfer
+   is done, after which the transfer must be ended with
+   dma_finish().  The caller must have downed D's channel's
+   access semaphore.
+
+   Returns false without touching the disk or advancing CUR if a
+   buffer can't be used for DMA, because it is not in kernel
+   memory or not 2-byte aligned; the caller should then fall back
+   to PIO. */
+static bool
+dma_start (struct ata_disk *d, block_sector_t sec_no, int cnt,
+           struct iov_cursor *cur, bool write) 
+{
+  struct channel *c = d->channel;
+  struct iov_cursor start = *cur;
+  uint8_t dir = write ? 0 : BMC_READ;
+  size_t prd_cnt = 0;
+  int i;
+
+  ASSERT (cnt > 0 && cnt <= MAX_SECTORS_PER_CMD);
+
+  /* Build the physical region descriptor table. */
+  for (i = 0; i < cnt; i++)
+    {
+      uint8_t *sector = iov_next_sector (cur);
+      if (!is_kernel_vaddr (sector) || ((uintptr_t) sector & 1) != 0
+          || !add_prd (c->prdt, &prd_cnt, vtop (sector), BLOCK_SECTOR_SIZE))
+        {
+          *cur = start;
+          return false;
+        }
+    }
+  c->prdt[prd_cnt - 1].flags = PRD_EOT;
+
+  /* Program the bus master, clearing stale error and interrupt
+     bits, then the disk, then start the transfer. */
+  outl (reg_bm_prdt (c), vtop (c->prdt));
+  outb (reg_bm_command (c), dir);
+  outb (reg_bm_status (c), inb (reg_bm_status (c)) | BMS_ERR | BMS_INTR);
+  if (!select_sector (d, sec_no, cnt))
+    issue_pio_command (c, write ? CMD_WRITE_DMA : CMD_READ_DMA);
+  else
+    issue_pio_command (c, write ? CMD_WRITE_DMA_EXT : CMD_READ_DMA_EXT);
+  outb (reg_bm_command (c), dir | BMC_START);
+  return true;
+}
+
+/* Ends a DMA transfer between disk D and memory, started by
+   dma_start() at SEC_NO in direction WRITE, after the disk has
+   interrupted.  Panics if the transfer failed.  May be called
+   from the interrupt handler. */
+static void
+dma_finish (struct ata_disk *d, block_sector_t sec_no, bool write) 
+{
+  struct channel *c = d->channel;
+  uint8_t bm_status;
+
+  outb (reg_bm_command (c), write ? 0 : BMC_READ);
+  bm_status = inb (reg_bm_status (c));
+  outb (reg_bm_status (c), bm_status);
+  if ((bm_status & BMS_ERR) != 0 || (inb (reg_status (c)) & STA_ERR) != 0)
+    PANIC ("%s: disk DMA %s failed, sector=%"PRDSNu,
+           d->name, write ? "write" : "read", sec_no);
+}
+
+/* Transfers CNT sectors, at most MAX_SECTORS_PER_CMD, starting at
+   SEC_NO between disk D and the buffers at CUR by DMA, as
+   dma_start(), and sleeps until the transfer completes.  The
+   caller must have downed D's channel's access semaphore.
+   Returns false if the caller should fall back to PIO. */
+static bool
+dma_transfer (struct ata_disk *d, block_sector_t sec_no, int cnt,
+              struct iov_cursor *cur, bool write) 
+{
+  if (!dma_start (d, sec_no, cnt, cur, write))
+    return false;
+  sema_down (&d->channel->completion_wait);
+  dma_finish (d, sec_no, write);
+  return true;
+}
+
+/* Reads consecutive sectors starting at SEC_NO from disk D into
+   the IOV_CNT buffers in IOV, using as few commands as possible.
+   Internally synchronizes accesses to disks, so external
+   per-disk locking is unneeded. */
+static void
+ide_read_multi (void *d_, block_sector_t sec_no,
+                const struct block_iovec *iov, size_t iov_cnt)
+{
+  struct ata_disk *d = d_;
+  struct channel *c = d->channel;
+  struct iov_cursor cur;
+  size_t cnt = 0;
+  size_t i;
+
+  for (i = 0; i < iov_cnt; i++)
+    cnt += iov[i].len / BLOCK_SECTOR_SIZE;
+  cur.iov = iov;
+  cur.ofs = 0;
+
+  sema_down (&c->access);
+  while (cnt > 0) 
+    {
+      int chunk = cnt < MAX_SECTORS_PER_CMD ? cnt : MAX_SECTORS_PER_CMD;
+      read_sectors (d, sec_no, chunk, &cur);
+      sec_no += chunk;
+      cnt -= chunk;
+    }
+  sema_up (&c->access);
+}
+
+/* Writes consecutive sectors starting at SEC_NO to disk D from
+   the IOV_CNT buffers in IOV, using as few commands as possible.
+   Returns after the disk has acknowledged receiving the data.
+   Internally synchronizes accesses to disks, so external
+   per-disk locking is unneeded. */
+static void
+ide_write_multi (void *d_, block_sector_t sec_no,
+                 const struct block_iovec *iov, size_t iov_cnt)
+{
+  struct ata_disk *d = d_;
+  struct channel *c = d->channel;
+  struct iov_cursor cur;
+  size_t cnt = 0;
+  size_t i;
+
+  for (i = 0; i < iov_cnt; i++)
+    cnt += iov[i].len / BLOCK_SECTOR_SIZE;
+  cur.iov = iov;
+  cur.ofs = 0;
+
+  sema_down (&c->access);
+  while (cnt > 0) 
+    {
+      int chunk = cnt < MAX_SECTORS_PER_CMD ? cnt : MAX_SECTORS_PER_CMD;
+      write_sectors (d, sec_no, chunk, &cur);
+      sec_no += chunk;
+      cnt -= chunk;
+    }
+  sema_up (&c->access);
+}
+
 /* Reads sector SEC_NO from disk D into BUFFER, which must have
    room for BLOCK_SECTOR_SIZE bytes.
    Internally synchronizes accesses to disks, so external
@@ -344,16 +829,11 @@ descramble_ata_string (char *string, int size)
 static void
 ide_read (void *d_, block_sector_t sec_no, void *buffer)
 {
-  struct ata_disk *d = d_;
-  struct channel *c = d->channel;
-  lock_acquire (&c->lock);
-  select_sector (d, sec_no);
-  issue_pio_command (c, CMD_READ_SECTOR_RETRY);
-  sema_down (&c->completion_wait);
-  if (!wait_while_busy (d))
-    PANIC ("%s: disk read failed, sector=%"PRDSNu, d->name, sec_no);
-  input_sector (c, buffer);
-  lock_release (&c->lock);
+  struct block_iovec iov;
+
+  iov.base = buffer;
+  iov.len = BLOCK_SECTOR_SIZE;
+  ide_read_multi (d_, sec_no, &iov, 1);
 }
 
 /* Write sector SEC_NO to disk D from BUFFER, which must contain
@@ -363,42 +843,108 @@ ide_read (void *d_, block_sector_t sec_no, void *buffer)
    per-disk locking is unneeded. */
 static void
 ide_write (void *d_, block_sector_t sec_no, const void *buffer)
+{
+  struct block_iovec iov;
+
+  iov.base = (void *) buffer;
+  iov.len = BLOCK_SECTOR_SIZE;
+  ide_write_multi (d_, sec_no, &iov, 1);
+}
+
+/* Starts transfer X on disk D.  If the transfer can be done with
+   a single DMA command, returns as soon as the command is
+   issued, and interrupt_handler() completes the transfer.
+   Otherwise, performs the transfer synchronously.  May sleep
+   until the channel is free. */
+static void
+ide_submit (void *d_, struct block_xfer *x)
 {
   struct ata_disk *d = d_;
   struct channel *c = d->channel;
-  lock_acquire (&c->lock);
-  select_sector (d, sec_no);
-  issue_pio_command (c, CMD_WRITE_SECTOR_RETRY);
-  if (!wait_while_busy (d))
-    PANIC ("%s: disk write failed, sector=%"PRDSNu, d->name, sec_no);
-  output_sector (c, buffer);
-  sema_down (&c->completion_wait);
-  lock_release (&c->lock);
+  size_t cnt = 0;
+  size_t i;
+
+  for (i = 0; i < x->iov_cnt; i++)
+    cnt += x->iov[i].len / BLOCK_SECTOR_SIZE;
+
+  if (d->dma && cnt <= MAX_SECTORS_PER_CMD)
+    {
+      struct iov_cursor cur;
+
+      cur.iov = x->iov;
+      cur.ofs = 0;
+      sema_down (&c->access);
+      c->xfer = x;
+      c->xfer_disk = d;
+      if (dma_start (d, x->sector, cnt, &cur, x->write))
+        return;
+      c->xfer = NULL;
+      sema_up (&c->access);
+    }
+
+  if (x->write)
+    ide_write_multi (d, x->sector, x->iov, x->iov_cnt);
+  else
+    ide_read_multi (d, x->sector, x->iov, x->iov_cnt);
+  block_complete (x);
 }
 
 static struct block_operations ide_operations =
   {
     ide_read,
-    ide_write
+    ide_write,
+    ide_read_multi,
+    ide_write_multi,
+    ide_submit
   };
-
+
 /* Selects device D, waiting for it to become ready, and then
-   writes SEC_NO to the disk's sector selection registers.  (We
-   use LBA mode.) */
-static void
-select_sector (struct ata_disk *d, block_sector_t sec_no)
+   writes SEC_NO and the number of sectors CNT, from 1 to
+   MAX_SECTORS_PER_CMD, to the disk's sector selection registers.
+   (We use LBA mode.)
+
+   Uses 28-bit LBA if all the sectors are within its reach, in
+   which case it returns false.  Otherwise, uses 48-bit LBA,
+   which D must support, and returns true; the caller must then
+   issue the EXT variant of its command. */
+static bool
+select_sector (struct ata_disk *d, block_sector_t sec_no, int cnt)
 {
   struct channel *c = d->channel;
 
-  ASSERT (sec_no < (1UL << 28));
+  ASSERT (cnt > 0 && cnt <= MAX_SECTORS_PER_CMD);
   
   select_device_wait (d);
-  outb (reg_nsect (c), 1);
-  outb (reg_lbal (c), sec_no);
-  outb (reg_lbam (c), sec_no >> 8);
-  outb (reg_lbah (c), (sec_no >> 16));
-  outb (reg_device (c),
-        DEV_MBS | DEV_LBA | (d->dev_no == 1 ? DEV_DEV : 0) | (sec_no >> 24));
+  if (sec_no <= LBA28_SECTORS - cnt)
+    {
+      outb (reg_nsect (c), cnt == MAX_SECTORS_PER_CMD ? 0 : cnt);
+      outb (reg_lbal (c), sec_no);
+      outb (reg_lbam (c), sec_no >> 8);
+      outb (reg_lbah (c), (sec_no >> 16));
+      outb (reg_device (c), (DEV_MBS | DEV_LBA
+                             | (d->dev_no == 1 ? DEV_DEV : 0)
+                             | (sec_no >> 24)));
+      return false;
+    }
+  else
+    {
+      ASSERT (d->lba48);
+
+      /* Each register is a two-byte FIFO: write the high-order
+         byte of each value, then the low-order byte.  Sector
+         numbers have only 32 bits, so LBA bits 47:32 are 0. */
+      outb (reg_nsect (c), cnt >> 8);
+      outb (reg_lbal (c), sec_no >> 24);
+      outb (reg_lbam (c), 0);
+      outb (reg_lbah (c), 0);
+      outb (reg_nsect (c), cnt);
+      outb (reg_lbal (c), sec_no);
+      outb (reg_lbam (c), sec_no >> 8);
+      outb (reg_lbah (c), sec_no >> 16);
+      outb (reg_device (c),
+            DEV_MBS | DEV_LBA | (d->dev_no == 1 ? DEV_DEV : 0));
+      return true;
+    }
 }
 
 /* Writes COMMAND to channel C and prepares for receiving a
@@ -511,7 +1057,18 @@ interrupt_handler (struct intr_frame *f)
   for (c = channels; c < channels + CHANNEL_CNT; c++)
     if (f->vec_no == c->irq)
       {
-        if (c->expecting_interrupt) 
+        if (c->expecting_interrupt && c->xfer != NULL) 
+          {
+            /* End of an asynchronous DMA transfer. */
+            struct block_xfer *x = c->xfer;
+
+            inb (reg_status (c));               /* Acknowledge interrupt. */
+            c->xfer = NULL;
+            dma_finish (c->xfer_disk, x->sector, x->write);
+            sema_up (&c->access);
+            block_complete (x);
+          }
+        else if (c->expecting_interrupt) 
           {
             inb (reg_status (c));               /* Acknowledge interrupt. */
             sema_up (&c->completion_wait);      /* Wake up waiter. */
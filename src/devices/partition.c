@@ -317,8 +317,56 @@ partition_write (void *p_, block_sector_t sector, const void *buffer)
   block_write (p->block, p->start + sector, buffer);
 }
 
+/* Reads consecutive sectors from partition P, starting at
+   SECTOR, into the IOV_CNT buffers in IOV. */
+static void
+partition_read_multi (void *p_, block_sector_t sector,
+                      const struct block_iovec *iov, size_t iov_cnt)
+{
+  struct partition *p = p_;
+  block_read_multi (p->block, p->start + sector, iov, iov_cnt);
+}
+
+/* Writes consecutive sectors to partition P, starting at SECTOR,
+   from the IOV_CNT buffers in IOV. */
+static void
+partition_write_multi (void *p_, block_sector_t sector,
+                       const struct block_iovec *iov, size_t iov_cnt)
+{
+  struct partition *p = p_;
+  block_write_multi (p->block, p->start + sector, iov, iov_cnt);
+}
+
+/* Completes the partition transfer whose request to the
+   underlying device, R, has completed. */
+static void
+partition_complete (struct block_request *r UNUSED, void *x)
+{
+  block_complete (x);
+}
+
+/* Starts transfer X on partition P by submitting it, offset by
+   the partition's start, to the underlying device. */
+static void
+partition_submit (void *p_, struct block_xfer *x)
+{
+  struct partition *p = p_;
+  struct block_request *r = &x->lower;
+
+  r->write = x->write;
+  r->sector = p->start + x->sector;
+  r->iov = x->iov;
+  r->iov_cnt = x->iov_cnt;
+  r->complete = partition_complete;
+  r->aux = x;
+  block_submit (p->block, r);
+}
+
 static struct block_operations partition_operations =
   {
     partition_read,
-    partition_write
+    partition_write,
+    partition_read_multi,
+    partition_write_multi,
+    partition_submit
   };
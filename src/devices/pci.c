@@ -0,0 +1,153 @@
+#include "devices/pci.h"
+#include <debug.h>
+#include "threads/interrupt.h"
+#include "threads/io.h"
+
+/* This code is a minimal interface to PCI configuration space,
+   using configuration mechanism #1, which every PC chipset that
+   Pintos runs on supports.  It is just enough for drivers to
+   find their devices and program them.  See [PCI] for
+   details. */
+
+/* Configuration mechanism #1 I/O ports. */
+#define PCI_CONFIG_ADDR 0xcf8   /* Selects a configuration register. */
+#define PCI_CONFIG_DATA 0xcfc   /* Accesses the selected register. */
+
+/* Enable bit in PCI_CONFIG_ADDR. */
+#define PCI_CONFIG_ENABLE 0x80000000
+
+/* Header type register bits. */
+#define PCI_HEADER_MULTI 0x80   /* Device has multiple functions. */
+
+static void select_reg (const struct pci_addr *, uint8_t reg);
+
+/* Searches the PCI buses, in order, for the IDX'th function
+   (counting from 0) for which MATCH returns true, given the
+   function's ID and class registers and AUX.  If there is one,
+   stores its location in *ADDR and returns true.  Otherwise,
+   returns false. */
+static bool
+find_function (bool (*match) (uint32_t id, uint32_t class, const void *aux),
+               const void *aux, int idx, struct pci_addr *addr)
+{
+  int bus, dev, func;
+
+  for (bus = 0; bus < 256; bus++)
+    for (dev = 0; dev < 32; dev++)
+      for (func = 0; func < 8; func++)
+        {
+          struct pci_addr a;
+          uint32_t id;
+
+          a.bus = bus;
+          a.dev = dev;
+          a.func = func;
+          id = pci_read_config (&a, PCI_REG_ID);
+          if ((id & 0xffff) == 0xffff)
+            {
+              /* No such function.  If function 0 is missing,
+                 the device is. */
+              if (func == 0)
+                break;
+              continue;
+            }
+
+          if (match (id, pci_read_config (&a, PCI_REG_CLASS), aux)
+              && idx-- == 0)
+            {
+              *addr = a;
+              return true;
+            }
+
+          /* Only multi-function devices have functions past 0. */
+          if (func == 0
+              && !(pci_read_config (&a, PCI_REG_HEADER)
+                   & (PCI_HEADER_MULTI << 16)))
+            break;
+        }
+  return false;
+}
+
+/* find_function() helper for pci_find_class().  AUX points to
+   the class and subclass, in that order. */
+static bool
+match_class (uint32_t id UNUSED, uint32_t class, const void *aux)
+{
+  const uint8_t *want = aux;
+  return (class >> 24) == want[0] && ((class >> 16) & 0xff) == want[1];
+}
+
+/* Searches the PCI buses for a function with the given CLASS
+   and SUBCLASS.  If one is found, stores its location in *ADDR
+   and returns true.  Otherwise, returns false. */
+bool
+pci_find_class (uint8_t class, uint8_t subclass, struct pci_addr *addr)
+{
+  uint8_t want[2];
+
+  want[0] = class;
+  want[1] = subclass;
+  return find_function (match_class, want, 0, addr);
+}
+
+/* find_function() helper for pci_find_device().  AUX points to
+   the wanted ID register value. */
+static bool
+match_device (uint32_t id, uint32_t class UNUSED, const void *aux)
+{
+  const uint32_t *want = aux;
+  return id == *want;
+}
+
+/* Searches the PCI buses for the IDX'th function, counting from
+   0, with the given VENDOR and DEVICE IDs.  If one is found,
+   stores its location in *ADDR and returns true.  Otherwise,
+   returns false. */
+bool
+pci_find_device (uint16_t vendor, uint16_t device, int idx,
+                 struct pci_addr *addr)
+{
+  uint32_t want = ((uint32_t) device << 16) | vendor;
+  return find_function (match_device, &want, idx, addr);
+}
+
+/* Returns the 32-bit configuration register at offset REG,
+   which must be a multiple of 4, of the function at ADDR. */
+uint32_t
+pci_read_config (const struct pci_addr *addr, uint8_t reg)
+{
+  enum intr_level old_level = intr_disable ();
+  uint32_t value;
+
+  select_reg (addr, reg);
+  value = inl (PCI_CONFIG_DATA);
+  intr_set_level (old_level);
+  return value;
+}
+
+/* Writes VALUE to the 32-bit configuration register at offset
+   REG, which must be a multiple of 4, of the function at
+   ADDR. */
+void
+pci_write_config (const struct pci_addr *addr, uint8_t reg, uint32_t value)
+{
+  enum intr_level old_level = intr_disable ();
+
+  select_reg (addr, reg);
+  outl (PCI_CONFIG_DATA, value);
+  intr_set_level (old_level);
+}
+
+/* Selects configuration register REG of the function at ADDR.
+   Interrupts must be off, so that the selection is not
+   disturbed before the data port is accessed. */
+static void
+select_reg (const struct pci_addr *addr, uint8_t reg)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (reg % 4 == 0);
+  ASSERT (addr->dev < 32 && addr->func < 8);
+
+  outl (PCI_CONFIG_ADDR, (PCI_CONFIG_ENABLE | (addr->bus << 16)
+                          | (addr->dev << 11) | (addr->func << 8) | reg));
+}
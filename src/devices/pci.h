@@ -0,0 +1,35 @@
+#ifndef DEVICES_PCI_H
+#define DEVICES_PCI_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Location of a PCI function in configuration space. */
+struct pci_addr
+  {
+    uint8_t bus;                /* Bus number, 0...255. */
+    uint8_t dev;                /* Device number, 0...31. */
+    uint8_t func;               /* Function number, 0...7. */
+  };
+
+/* Offsets of standard configuration space registers. */
+#define PCI_REG_ID 0x00         /* Device ID 31:16, vendor ID 15:0. */
+#define PCI_REG_CMD 0x04        /* Status 31:16, command 15:0. */
+#define PCI_REG_CLASS 0x08      /* Class 31:24, subclass 23:16,
+                                   prog IF 15:8, revision 7:0. */
+#define PCI_REG_HEADER 0x0c     /* Header type 23:16. */
+#define PCI_REG_BAR0 0x10       /* First of six base address regs. */
+#define PCI_REG_IRQ 0x3c        /* Interrupt line 7:0. */
+
+/* Command register bits. */
+#define PCI_CMD_IO 0x0001       /* Respond to I/O space accesses. */
+#define PCI_CMD_MEM 0x0002      /* Respond to memory space accesses. */
+#define PCI_CMD_MASTER 0x0004   /* Allow bus mastering. */
+
+bool pci_find_class (uint8_t class, uint8_t subclass, struct pci_addr *);
+bool pci_find_device (uint16_t vendor, uint16_t device, int idx,
+                      struct pci_addr *);
+uint32_t pci_read_config (const struct pci_addr *, uint8_t reg);
+void pci_write_config (const struct pci_addr *, uint8_t reg, uint32_t);
+
+#endif /* devices/pci.h */
@@ -11,9 +11,6 @@
 #define PIT_PORT_CONTROL          0x43                /* Control port. */
 #define PIT_PORT_COUNTER(CHANNEL) (0x40 + (CHANNEL))  /* Counter port. */
 
-/* PIT cycles per second. */
-#define PIT_HZ 1193180
-
 /* Configure the given CHANNEL in the PIT.  In a PC, the PIT's
    three output channels are hooked up like this:
 
@@ -81,3 +78,71 @@ pit_configure_channel (int channel, int mode, int frequency)
   outb (PIT_PORT_COUNTER (channel), count >> 8);
   intr_set_level (old_level);
 }
+
+/* Loads COUNT into the given CHANNEL in mode 0, "interrupt on
+   terminal count": the channel's output goes high once, after
+   COUNT cycles of the PIT clock, and stays high until the
+   channel is reprogrammed.  The counter keeps decrementing past
+   0, wrapping around to 0xffff.  A COUNT of 0 is treated as
+   65536. */
+void
+pit_start_oneshot (int channel, uint16_t count)
+{
+  enum intr_level old_level;
+
+  ASSERT (channel == 0 || channel == 2);
+
+  old_level = intr_disable ();
+  outb (PIT_PORT_CONTROL, (channel << 6) | 0x30);
+  outb (PIT_PORT_COUNTER (channel), count);
+  outb (PIT_PORT_COUNTER (channel), count >> 8);
+  intr_set_level (old_level);
+}
+
+/* Returns the current value of the given CHANNEL's counter,
+   which counts down once per PIT clock cycle. */
+uint16_t
+pit_read_count (int channel)
+{
+  enum intr_level old_level;
+  uint16_t count;
+
+  ASSERT (channel == 0 || channel == 2);
+
+  /* The counter latch command freezes a copy of the counter
+     until both of its bytes have been read. */
+  old_level = intr_disable ();
+  outb (PIT_PORT_CONTROL, channel << 6);
+  count = inb (PIT_PORT_COUNTER (channel));
+  count |= inb (PIT_PORT_COUNTER (channel)) << 8;
+  intr_set_level (old_level);
+
+  return count;
+}
+
+/* Latches the given CHANNEL's counter and status together with
+   the read-back command, and stores the counter in *COUNT and the
+   state of the channel's output in *OUT.  In mode 0, the output
+   goes high when the count reaches 0, so *OUT tells for certain
+   whether the countdown has expired, even if the counter has
+   since wrapped around. */
+void
+pit_read_back (int channel, uint16_t *count, bool *out)
+{
+  enum intr_level old_level;
+  uint8_t status;
+
+  ASSERT (channel == 0 || channel == 2);
+
+  /* Read-back command: latch count and status for CHANNEL only.
+     The status byte comes first, then the count, low byte
+     first. */
+  old_level = intr_disable ();
+  outb (PIT_PORT_CONTROL, 0xc0 | (2 << channel));
+  status = inb (PIT_PORT_COUNTER (channel));
+  *count = inb (PIT_PORT_COUNTER (channel));
+  *count |= inb (PIT_PORT_COUNTER (channel)) << 8;
+  intr_set_level (old_level);
+
+  *out = (status & 0x80) != 0;
+}
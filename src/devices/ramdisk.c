@@ -0,0 +1,115 @@
+#include "devices/ramdisk.h"
+#include <debug.h>
+#include <round.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/block.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+
+/* A RAM disk is a block device whose sectors are kept in memory,
+   so that it is as fast as memcpy().  Its contents are lost at
+   power off.  It is registered as "rd0", of type "raw", and can
+   be given a role with, e.g., "-filesys=rd0".
+
+   The RAM disk is stored in individual pages from the user pool,
+   so that a large one does not starve the kernel of memory, and
+   rather than one large block, because the pool may be too
+   fragmented to supply a large block.  Use "-ul" to leave room
+   for user processes.
+
+   Every transfer is finished by the time ramdisk_submit()
+   returns, so a request on an idle RAM disk is carried out in
+   the submitting thread without involving the block layer's
+   dispatcher thread. */
+
+/* Sectors per page. */
+#define SECTORS_PER_PAGE (PGSIZE / BLOCK_SECTOR_SIZE)
+
+/* Size of the RAM disk in kB, or 0 for no RAM disk. */
+size_t ramdisk_kb;
+
+/* Pages holding the RAM disk's sectors. */
+static uint8_t **pages;
+
+static struct block_operations ramdisk_operations;
+
+/* Creates the RAM disk, if one was requested, and registers it
+   with the block layer. */
+void
+ramdisk_init (void) 
+{
+  block_sector_t sector_cnt;
+  size_t page_cnt, i;
+
+  if (ramdisk_kb == 0)
+    return;
+
+  sector_cnt = ramdisk_kb * 1024 / BLOCK_SECTOR_SIZE;
+  page_cnt = DIV_ROUND_UP (sector_cnt, SECTORS_PER_PAGE);
+  pages = malloc (page_cnt * sizeof *pages);
+  if (pages == NULL)
+    PANIC ("ramdisk: couldn't allocate page table");
+  for (i = 0; i < page_cnt; i++)
+    {
+      pages[i] = palloc_get_page (PAL_USER | PAL_ZERO);
+      if (pages[i] == NULL)
+        PANIC ("ramdisk: out of memory after %zu kB", i * PGSIZE / 1024);
+    }
+
+  block_register ("rd0", BLOCK_RAW, "RAM disk", sector_cnt,
+                  &ramdisk_operations, NULL);
+}
+
+/* Returns the address of SECTOR in the RAM disk. */
+static uint8_t *
+sector_addr (block_sector_t sector) 
+{
+  return (pages[sector / SECTORS_PER_PAGE]
+          + sector % SECTORS_PER_PAGE * BLOCK_SECTOR_SIZE);
+}
+
+/* Reads sector SECTOR from the RAM disk into BUFFER, which must
+   have room for BLOCK_SECTOR_SIZE bytes. */
+static void
+ramdisk_read (void *aux UNUSED, block_sector_t sector, void *buffer) 
+{
+  memcpy (buffer, sector_addr (sector), BLOCK_SECTOR_SIZE);
+}
+
+/* Writes sector SECTOR to the RAM disk from BUFFER, which must
+   contain BLOCK_SECTOR_SIZE bytes. */
+static void
+ramdisk_write (void *aux UNUSED, block_sector_t sector, const void *buffer) 
+{
+  memcpy (sector_addr (sector), buffer, BLOCK_SECTOR_SIZE);
+}
+
+/* Carries out transfer X and completes it before returning. */
+static void
+ramdisk_submit (void *aux UNUSED, struct block_xfer *x)
+{
+  block_sector_t sector = x->sector;
+  size_t i, ofs;
+
+  for (i = 0; i < x->iov_cnt; i++)
+    for (ofs = 0; ofs < x->iov[i].len; ofs += BLOCK_SECTOR_SIZE)
+      {
+        uint8_t *buffer = (uint8_t *) x->iov[i].base + ofs;
+        if (x->write)
+          memcpy (sector_addr (sector++), buffer, BLOCK_SECTOR_SIZE);
+        else
+          memcpy (buffer, sector_addr (sector++), BLOCK_SECTOR_SIZE);
+      }
+  block_complete (x);
+}
+
+static struct block_operations ramdisk_operations =
+  {
+    ramdisk_read,
+    ramdisk_write,
+    NULL,
+    NULL,
+    ramdisk_submit
+  };
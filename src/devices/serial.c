@@ -1,7 +1,8 @@
 #include "devices/serial.h"
 #include <debug.h>
+#include <list.h>
+#include <stdio.h>
 #include "devices/input.h"
-#include "devices/intq.h"
 #include "devices/timer.h"
 #include "threads/io.h"
 #include "threads/interrupt.h"
@@ -12,7 +13,12 @@
    The 16550A has a lot more going on than shown here, but this
    is all we need.
 
-   Refer to [PC16650D] for hardware information. */
+   Refer to [PC16650D] for hardware information.
+
+   Output is queued in a large transmit ring.  Each transmit
+   interrupt refills the UART's 16-byte transmit FIFO from the
+   ring, so that the CPU is interrupted once per 16 bytes rather
+   than once per byte. */
 
 /* I/O port base address for the first serial port. */
 #define IO_BASE 0x3f8
@@ -33,6 +39,14 @@
 #define MCR_REG (IO_BASE + 4)   /* MODEM Control Register. */
 #define LSR_REG (IO_BASE + 5)   /* Line Status Register (read-only). */
 
+/* FIFO Control Register bits. */
+#define FCR_ENABLE 0x01         /* Enable FIFOs. */
+#define FCR_CLEAR_RX 0x02       /* Clear receive FIFO. */
+#define FCR_CLEAR_TX 0x04       /* Clear transmit FIFO. */
+
+/* Interrupt Identification Register bits. */
+#define IIR_FIFO 0xc0           /* FIFOs enabled (both bits set). */
+
 /* Interrupt Enable Register bits. */
 #define IER_RECV 0x01           /* Interrupt when data received. */
 #define IER_XMIT 0x02           /* Interrupt when transmit finishes. */
@@ -51,11 +65,31 @@
 /* Transmission mode. */
 static enum { UNINIT, POLL, QUEUE } mode;
 
-/* Data to be transmitted. */
-static struct intq txq;
+/* Size of the transmit ring in bytes.  Must be a power of 2. */
+#define TXQ_SIZE 8192
+
+/* Data to be transmitted.  TXQ_HEAD counts bytes added to the
+   ring and TXQ_TAIL bytes removed, so that the ring holds
+   TXQ_HEAD - TXQ_TAIL bytes.  Interrupts must be off to access
+   the ring. */
+static uint8_t txq[TXQ_SIZE];
+static unsigned txq_head, txq_tail;
+
+/* Threads waiting for room in the transmit ring. */
+static struct list txq_waiters = LIST_INITIALIZER (txq_waiters);
+
+/* Number of bytes that may be written to the UART at once when
+   THR is empty: 16 if its FIFOs work, as on a 16550A, else 1. */
+static int fifo_size = 1;
+
+/* Statistics. */
+static unsigned long long sent_cnt;     /* Bytes sent. */
+static unsigned long long poll_cnt;     /* Bytes sent by polling. */
+static unsigned long long fill_cnt;     /* FIFO fills by interrupt. */
 
 static void set_serial (int bps);
 static void putc_poll (uint8_t);
+static void fill_fifo_poll (void);
 static void write_ier (void);
 static intr_handler_func serial_interrupt;
 
@@ -68,10 +102,16 @@ init_poll (void)
 {
   ASSERT (mode == UNINIT);
   outb (IER_REG, 0);                    /* Turn off all interrupts. */
-  outb (FCR_REG, 0);                    /* Disable FIFO. */
   set_serial (9600);                    /* 9.6 kbps, N-8-1. */
   outb (MCR_REG, MCR_OUT2);             /* Required to enable interrupts. */
-  intq_init (&txq);
+
+  /* Enable and clear the FIFOs.  Only a UART whose FIFOs work,
+     such as a 16550A, reports them enabled in the IIR. */
+  outb (FCR_REG, FCR_ENABLE | FCR_CLEAR_RX | FCR_CLEAR_TX);
+  if ((inb (IIR_REG) & IIR_FIFO) == IIR_FIFO)
+    fifo_size = 16;
+  else
+    outb (FCR_REG, 0);
   mode = POLL;
 } 
 
@@ -94,35 +134,90 @@ serial_init_queue (void)
   intr_set_level (old_level);
 }
 
+/* Returns true if the transmit ring is empty. */
+static bool
+txq_empty (void) 
+{
+  return txq_head == txq_tail;
+}
+
+/* Returns true if the transmit ring is full. */
+static bool
+txq_full (void) 
+{
+  return txq_head - txq_tail == TXQ_SIZE;
+}
+
+/* Removes and returns the oldest byte in the transmit ring,
+   which must not be empty. */
+static uint8_t
+txq_getc (void) 
+{
+  ASSERT (!txq_empty ());
+  return txq[txq_tail++ % TXQ_SIZE];
+}
+
+/* Waits until the transmit ring is not full.  OLD_LEVEL is the
+   interrupt level before the caller disabled interrupts. */
+static void
+wait_for_room (enum intr_level old_level) 
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  while (txq_full ()) 
+    if (old_level == INTR_ON) 
+      {
+        /* Wait for the interrupt handler to make room. */
+        write_ier ();
+        list_push_back (&txq_waiters, &thread_current ()->elem);
+        thread_block ();
+      }
+    else
+      {
+        /* Interrupts are off and the transmit ring is full.
+           If we wanted to wait for the ring to empty, we'd have
+           to reenable interrupts.  That's impolite, so we'll
+           send a FIFO's worth via polling instead. */
+        fill_fifo_poll ();
+      }
+}
+
 /* Sends BYTE to the serial port. */
 void
 serial_putc (uint8_t byte) 
 {
+  serial_putbuf (&byte, 1);
+}
+
+/* Sends the N bytes in BUFFER to the serial port. */
+void
+serial_putbuf (const void *buffer_, size_t n) 
+{
+  const uint8_t *buffer = buffer_;
   enum intr_level old_level = intr_disable ();
 
   if (mode != QUEUE)
     {
       /* If we're not set up for interrupt-driven I/O yet,
-         use dumb polling to transmit a byte. */
+         use dumb polling to transmit the bytes. */
       if (mode == UNINIT)
         init_poll ();
-      putc_poll (byte); 
+      while (n-- > 0)
+        putc_poll (*buffer++); 
     }
   else 
     {
-      /* Otherwise, queue a byte and update the interrupt enable
-         register. */
-      if (old_level == INTR_OFF && intq_full (&txq)) 
+      /* Otherwise, queue as many bytes as fit at a time and update
+         the interrupt enable register. */
+      while (n > 0) 
         {
-          /* Interrupts are off and the transmit queue is full.
-             If we wanted to wait for the queue to empty,
-             we'd have to reenable interrupts.
-             That's impolite, so we'll send a character via
-             polling instead. */
-          putc_poll (intq_getc (&txq)); 
-        }
+          size_t room;
 
-      intq_putc (&txq, byte); 
+          wait_for_room (old_level);
+          for (room = TXQ_SIZE - (txq_head - txq_tail); room > 0 && n > 0;
+               room--, n--)
+            txq[txq_head++ % TXQ_SIZE] = *buffer++;
+        }
       write_ier ();
     }
   
@@ -135,11 +230,20 @@ void
 serial_flush (void) 
 {
   enum intr_level old_level = intr_disable ();
-  while (!intq_empty (&txq))
-    putc_poll (intq_getc (&txq));
+  while (!txq_empty ())
+    fill_fifo_poll ();
   intr_set_level (old_level);
 }
 
+/* Prints serial port statistics. */
+void
+serial_print_stats (void) 
+{
+  printf ("Serial: %llu bytes sent, %llu by polling, "
+          "%llu FIFO fills of up to %d bytes\n",
+          sent_cnt, poll_cnt, fill_cnt, fifo_size);
+}
+
 /* The fullness of the input buffer may have changed.  Reassess
    whether we should block receive interrupts.
    Called by the input buffer routines when characters are added
@@ -182,7 +286,7 @@ write_ier (void)
 
   /* Enable transmit interrupt if we have any characters to
      transmit. */
-  if (!intq_empty (&txq))
+  if (!txq_empty ())
     ier |= IER_XMIT;
 
   /* Enable receive interrupt if we have room to store any
@@ -203,6 +307,25 @@ putc_poll (uint8_t byte)
   while ((inb (LSR_REG) & LSR_THRE) == 0)
     continue;
   outb (THR_REG, byte);
+  sent_cnt++;
+  poll_cnt++;
+}
+
+/* Polls the serial port until its transmitter is empty, and then
+   fills its FIFO from the transmit ring. */
+static void
+fill_fifo_poll (void) 
+{
+  int i;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  while ((inb (LSR_REG) & LSR_THRE) == 0)
+    continue;
+  for (i = 0; i < fifo_size && !txq_empty (); i++)
+    outb (THR_REG, txq_getc ());
+  sent_cnt += i;
+  poll_cnt += i;
 }
 
 /* Serial interrupt handler. */
@@ -218,10 +341,23 @@ serial_interrupt (struct intr_frame *f UNUSED)
   while (!input_full () && (inb (LSR_REG) & LSR_DR) != 0)
     input_putc (inb (RBR_REG));
 
-  /* As long as we have a byte to transmit, and the hardware is
-     ready to accept a byte for transmission, transmit a byte. */
-  while (!intq_empty (&txq) && (inb (LSR_REG) & LSR_THRE) != 0) 
-    outb (THR_REG, intq_getc (&txq));
+  /* If we have bytes to transmit and the transmitter is empty,
+     fill its FIFO.  (With the FIFOs enabled, THRE means that the
+     whole transmit FIFO is empty, not just one byte.) */
+  if (!txq_empty () && (inb (LSR_REG) & LSR_THRE) != 0) 
+    {
+      int i;
+
+      for (i = 0; i < fifo_size && !txq_empty (); i++)
+        outb (THR_REG, txq_getc ());
+      sent_cnt += i;
+      fill_cnt++;
+    }
+
+  /* Wake up threads waiting for room in the ring. */
+  while (!txq_full () && !list_empty (&txq_waiters))
+    thread_unblock (list_entry (list_pop_front (&txq_waiters),
+                                struct thread, elem));
 
   /* Update interrupt enable register based on queue status. */
   write_ier ();
@@ -4,14 +4,22 @@
 #include "devices/kbd.h"
 #include "devices/serial.h"
 #include "devices/timer.h"
+#include "threads/fpu.h"
+#include "threads/interrupt.h"
 #include "threads/io.h"
+#include "threads/lockstat.h"
+#include "threads/profile.h"
 #include "threads/thread.h"
+#include "threads/trace.h"
+#include "threads/workqueue.h"
 #ifdef USERPROG
 #include "userprog/exception.h"
 #endif
 #ifdef FILESYS
 #include "devices/block.h"
 #include "filesys/filesys.h"
+#include "filesys/inode.h"
+#include "filesys/journal.h"
 #endif
 
 /* Keyboard control register port. */
@@ -120,12 +128,22 @@ print_stats (void)
 {
   timer_print_stats ();
   thread_print_stats ();
+#ifdef LOCKSTAT
+  lockstat_print_stats ();
+#endif
+  intr_print_stats ();
+  workqueue_print_stats ();
+  fpu_print_stats ();
 #ifdef FILESYS
   block_print_stats ();
+  journal_print_stats ();
+  inode_print_stats ();
 #endif
   console_print_stats ();
   kbd_print_stats ();
 #ifdef USERPROG
   exception_print_stats ();
 #endif
+  profile_print_stats ();
+  trace_dump ();
 }
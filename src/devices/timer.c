@@ -1,10 +1,12 @@
 #include "devices/timer.h"
 #include <debug.h>
 #include <inttypes.h>
+#include <list.h>
 #include <round.h>
 #include <stdio.h>
 #include "devices/pit.h"
 #include "threads/interrupt.h"
+#include "threads/profile.h"
 #include "threads/synch.h"
 #include "threads/thread.h"
   
@@ -17,14 +19,86 @@
 #error TIMER_FREQ <= 1000 recommended
 #endif
 
-/* Number of timer ticks since OS booted. */
+/* Number of timer ticks since OS booted.  Too wide to read
+   atomically, so readers outside the timer interrupt use
+   ticks_seq. */
 static int64_t ticks;
+static struct seqlock ticks_seq;
+
+/* PIT cycles per timer tick. */
+#define TICK_COUNT ((PIT_HZ + TIMER_FREQ / 2) / TIMER_FREQ)
+
+/* Most timer ticks that fit in one PIT one-shot countdown. */
+#define IDLE_MAX_TICKS (UINT16_MAX / TICK_COUNT)
+
+/* Timer wheel.
+
+   Pending timers are kept in a hierarchy of WHEEL_LEVELS wheels
+   of WHEEL_SIZE slots each.  A timer due within WHEEL_SIZE ticks
+   goes in level 0, in the slot for its exact expiration tick.  A
+   timer due later goes in the slot of the first level whose span
+   covers it, indexed by the corresponding bits of its expiration
+   tick.  Each time level 0 wraps around, the next slot of level 1
+   is "cascaded": its timers are redistributed into level 0, and
+   so on up the hierarchy.  Adding and canceling a timer is O(1),
+   and each tick costs O(1) plus the work of cascading, which is
+   amortized over the timers that were cascaded.
+
+   All of this is protected by disabling interrupts. */
+#define WHEEL_BITS 6                    /* Bits of tick per level. */
+#define WHEEL_SIZE (1 << WHEEL_BITS)    /* Slots per level. */
+#define WHEEL_MASK (WHEEL_SIZE - 1)
+#define WHEEL_LEVELS 4                  /* Levels. */
+#define WHEEL_SPAN (1 << (WHEEL_BITS * WHEEL_LEVELS))
+
+static struct list wheel[WHEEL_LEVELS][WHEEL_SIZE];
+
+/* Next tick whose level-0 slot is to be expired. */
+static int64_t wheel_next;
+
+/* Timers that have come due but whose callbacks have not yet
+   been run by timer_run_expired(). */
+static struct list expired_list;
+
+/* If true, stop the periodic timer tick while the CPU is idle.
+   Controlled by kernel command-line option "-tickless". */
+bool timer_tickless;
+
+/* If true, act as if the CPU had no time-stamp counter, and
+   calibrate with busy-wait loops instead.  Controlled by kernel
+   command-line option "-no-tsc", so that the two calibrations'
+   boot times can be compared on one kernel. */
+bool timer_no_tsc;
+
+/* Tickless idle state, valid only while idle_oneshot is true. */
+static bool idle_oneshot;       /* PIT is in one-shot mode? */
+static int idle_span;           /* Ticks covered by the countdown. */
+static uint16_t idle_first;     /* PIT cycles left in first tick. */
+
+/* True while the PIT counts down the rest of the tick that was in
+   progress when a non-timer interrupt woke the idle CPU.  The
+   periodic tick resumes from the timer interrupt that ends it. */
+static bool idle_resync;
 
 /* Number of loops per timer tick.
-   Initialized by timer_calibrate(). */
+   Initialized by timer_calibrate(), only if the CPU lacks a
+   time-stamp counter. */
 static unsigned loops_per_tick;
 
+/* Time-stamp counter cycles per timer tick, or 0 if the TSC is
+   not in use.  Initialized by timer_calibrate(). */
+static int64_t cycles_per_tick;
+
 static intr_handler_func timer_interrupt;
+static void wheel_insert (struct timer *);
+static void wheel_cascade (int level);
+static void wheel_advance (void);
+static int64_t ticks_to_next_timer (int64_t max);
+static void wake_sleeper (struct timer *, void *thread);
+static bool have_tsc (void);
+static inline int64_t rdtsc (void);
+static void wait_for_tick (void);
+static void calibrate_loops (void);
 static bool too_many_loops (unsigned loops);
 static void busy_wait (int64_t loops);
 static void real_time_sleep (int64_t num, int32_t denom);
@@ -35,44 +109,65 @@ static void real_time_delay (int64_t num, int32_t denom);
 void
 timer_init (void) 
 {
+  int level, slot;
+
+  seqlock_init (&ticks_seq);
+  for (level = 0; level < WHEEL_LEVELS; level++)
+    for (slot = 0; slot < WHEEL_SIZE; slot++)
+      list_init (&wheel[level][slot]);
+  list_init (&expired_list);
+  wheel_next = ticks + 1;
+
   pit_configure_channel (0, 2, TIMER_FREQ);
   intr_register_ext (0x20, timer_interrupt, "8254 Timer");
 }
 
-/* Calibrates loops_per_tick, used to implement brief delays. */
+/* Calibrates the time-stamp counter against the timer, or
+   loops_per_tick if the CPU has no TSC.  Either is used to
+   implement brief delays.
+
+   The TSC is timed across a single timer tick, which takes far
+   less time than the binary search over busy-wait loop counts
+   that calibrate_loops() needs. */
 void
 timer_calibrate (void) 
 {
-  unsigned high_bit, test_bit;
+  int64_t start;
 
   ASSERT (intr_get_level () == INTR_ON);
   printf ("Calibrating timer...  ");
 
-  /* Approximate loops_per_tick as the largest power-of-two
-     still less than one timer tick. */
-  loops_per_tick = 1u << 10;
-  while (!too_many_loops (loops_per_tick << 1)) 
+  if (!have_tsc ())
     {
-      loops_per_tick <<= 1;
-      ASSERT (loops_per_tick != 0);
+      calibrate_loops ();
+      printf ("%'"PRIu64" loops/s.\n",
+              (uint64_t) loops_per_tick * TIMER_FREQ);
+      return;
     }
 
-  /* Refine the next 8 bits of loops_per_tick. */
-  high_bit = loops_per_tick;
-  for (test_bit = high_bit >> 1; test_bit != high_bit >> 10; test_bit >>= 1)
-    if (!too_many_loops (high_bit | test_bit))
-      loops_per_tick |= test_bit;
+  wait_for_tick ();
+  start = rdtsc ();
+  wait_for_tick ();
+  cycles_per_tick = rdtsc () - start;
+  if (cycles_per_tick <= 0)
+    PANIC ("time-stamp counter is not monotonic");
 
-  printf ("%'"PRIu64" loops/s.\n", (uint64_t) loops_per_tick * TIMER_FREQ);
+  printf ("%'"PRIu64" cycles/s.\n", (uint64_t) cycles_per_tick * TIMER_FREQ);
 }
 
 /* Returns the number of timer ticks since the OS booted. */
 int64_t
 timer_ticks (void) 
 {
-  enum intr_level old_level = intr_disable ();
-  int64_t t = ticks;
-  intr_set_level (old_level);
+  unsigned start;
+  int64_t t;
+
+  do 
+    {
+      start = seqlock_read_begin (&ticks_seq);
+      t = ticks;
+    }
+  while (seqlock_read_retry (&ticks_seq, start));
   return t;
 }
 
@@ -84,16 +179,68 @@ timer_elapsed (int64_t then)
   return timer_ticks () - then;
 }
 
+/* Returns a monotonic count of CPU cycles, read from the
+   time-stamp counter.  On a CPU without a TSC, the count is
+   synthesized from the number of timer ticks and advances only
+   once per tick.  Must not be called before the kernel has
+   cleared BSS, which holds the calibration results, and parsed
+   the "-no-tsc" option. */
+int64_t
+timer_cycles (void) 
+{
+  if (cycles_per_tick == 0 && !have_tsc ())
+    {
+      /* timer_ticks() does not disable interrupts, so this
+         function can be used to time how long they are off. */
+      return timer_ticks () * loops_per_tick;
+    }
+  return rdtsc ();
+}
+
+/* Converts CYCLES, a difference between two values returned by
+   timer_cycles(), into nanoseconds.  Returns 0 before
+   timer_calibrate() has run. */
+int64_t
+timer_cycles_to_ns (int64_t cycles) 
+{
+  int64_t hz;
+
+  if (cycles_per_tick != 0)
+    hz = cycles_per_tick * TIMER_FREQ;
+  else if (loops_per_tick != 0)
+    hz = (int64_t) loops_per_tick * TIMER_FREQ;
+  else
+    return 0;
+
+  /* Split the product to keep it from overflowing. */
+  return (cycles / hz * 1000000000
+          + cycles % hz * 1000000000 / hz);
+}
+
+/* Returns the number of nanoseconds counted by timer_cycles(). */
+int64_t
+timer_ns (void) 
+{
+  return timer_cycles_to_ns (timer_cycles ());
+}
+
 /* Sleeps for approximately TICKS timer ticks.  Interrupts must
    be turned on. */
 void
 timer_sleep (int64_t ticks) 
 {
-  int64_t start = timer_ticks ();
+  struct timer t;
+  enum intr_level old_level;
 
   ASSERT (intr_get_level () == INTR_ON);
-  while (timer_elapsed (start) < ticks) 
-    thread_yield ();
+  if (ticks <= 0)
+    return;
+
+  old_level = intr_disable ();
+  timer_setup (&t, wake_sleeper, thread_current ());
+  timer_arm (&t, timer_ticks () + ticks);
+  thread_block ();
+  intr_set_level (old_level);
 }
 
 /* Sleeps for approximately MS milliseconds.  Interrupts must be
@@ -159,6 +306,179 @@ timer_ndelay (int64_t ns)
   real_time_delay (ns, 1000 * 1000 * 1000);
 }
 
+/* Initializes timer T to call FUNC, passing T and AUX, once it
+   is armed and comes due. */
+void
+timer_setup (struct timer *t, timer_func *func, void *aux) 
+{
+  ASSERT (t != NULL);
+  ASSERT (func != NULL);
+
+  t->func = func;
+  t->aux = aux;
+  t->pending = false;
+}
+
+/* Arms timer T to run its callback at timer tick EXPIRES, as
+   would be returned by timer_ticks().  If EXPIRES has already
+   passed, the callback runs after the next tick.  If T was
+   already pending, it is rescheduled.
+
+   The callback runs after the timer interrupt for tick EXPIRES
+   has been acknowledged, with interrupts off, so it must not
+   sleep.  It may re-arm T.  May be called from an interrupt
+   handler or a timer callback. */
+void
+timer_arm (struct timer *t, int64_t expires) 
+{
+  enum intr_level old_level;
+
+  ASSERT (t != NULL && t->func != NULL);
+
+  old_level = intr_disable ();
+  if (t->pending)
+    list_remove (&t->elem);
+  t->expires = expires;
+  t->pending = true;
+  wheel_insert (t);
+  intr_set_level (old_level);
+}
+
+/* Cancels timer T.  Returns true if T was pending, false if it
+   was not armed or its callback has already started running.
+   Once this function returns, T's callback will not be called
+   until T is armed again. */
+bool
+timer_cancel (struct timer *t) 
+{
+  enum intr_level old_level;
+  bool was_pending;
+
+  ASSERT (t != NULL);
+
+  old_level = intr_disable ();
+  was_pending = t->pending;
+  if (was_pending)
+    {
+      list_remove (&t->elem);
+      t->pending = false;
+    }
+  intr_set_level (old_level);
+
+  return was_pending;
+}
+
+/* Returns true if timer T is armed and its callback has not
+   started running yet. */
+bool
+timer_pending (const struct timer *t) 
+{
+  return t->pending;
+}
+
+/* Runs the callbacks of timers that came due at the last timer
+   tick.  Called at the end of every external interrupt, once the
+   interrupt has been acknowledged. */
+void
+timer_run_expired (void) 
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  while (!list_empty (&expired_list))
+    {
+      struct timer *t = list_entry (list_pop_front (&expired_list),
+                                    struct timer, elem);
+      t->pending = false;
+      t->func (t, t->aux);
+    }
+}
+
+/* Called by the idle thread, with interrupts off, just before
+   it halts the CPU.  If tickless idle is enabled, replaces the
+   periodic timer tick by a single PIT countdown that expires at
+   the tick when the next timer comes due, or as far in the
+   future as the PIT allows. */
+void
+timer_idle_enter (void) 
+{
+  int64_t n;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+  if (!timer_tickless || idle_oneshot)
+    return;
+
+  /* Nothing to gain unless at least one tick is skipped. */
+  n = ticks_to_next_timer (IDLE_MAX_TICKS);
+  if (n < 2)
+    return;
+
+  /* Start the countdown so that it expires exactly when the Nth
+     periodic tick would have. */
+  idle_first = pit_read_count (0);
+  if (idle_first == 0 || idle_first > TICK_COUNT)
+    return;
+  idle_span = n;
+  idle_oneshot = true;
+  idle_resync = false;
+  pit_start_oneshot (0, idle_first + (n - 1) * TICK_COUNT);
+}
+
+/* Called at the start of every external interrupt.  If the idle
+   thread stopped the periodic tick, restarts it, in phase with
+   the ticks it replaced, and adds the ticks that would have
+   occurred in the meantime to the tick count. */
+void
+timer_idle_exit (void) 
+{
+  uint16_t count, total, elapsed;
+  bool expired;
+  int skipped;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+  if (!idle_oneshot)
+    return;
+  idle_oneshot = false;
+
+  total = idle_first + (idle_span - 1) * TICK_COUNT;
+  pit_read_back (0, &count, &expired);
+  if (expired)
+    {
+      /* The countdown expired, so its interrupt is either the
+         one being handled or pending, and timer_interrupt()
+         will count the last tick.  The count itself cannot tell
+         us this, because it wraps around past 0. */
+      skipped = idle_span - 1;
+      pit_configure_channel (0, 2, TIMER_FREQ);
+    }
+  else
+    {
+      /* Woken early by some other interrupt.  Reprogramming the
+         periodic tick right away would throw away the part of
+         the current tick that has already elapsed, so the clock
+         would fall behind a little on every such wakeup.
+         Instead, count down just the rest of this tick and let
+         timer_interrupt() restart the periodic tick. */
+      elapsed = total - count;
+      if (elapsed < idle_first)
+        {
+          skipped = 0;
+          pit_start_oneshot (0, idle_first - elapsed);
+        }
+      else
+        {
+          skipped = (elapsed - idle_first) / TICK_COUNT + 1;
+          pit_start_oneshot (0, TICK_COUNT
+                                - (elapsed - idle_first) % TICK_COUNT);
+        }
+      idle_resync = true;
+    }
+
+  seqlock_write_begin (&ticks_seq);
+  ticks += skipped;
+  seqlock_write_end (&ticks_seq);
+  thread_skip_ticks (skipped);
+}
+
 /* Prints timer statistics. */
 void
 timer_print_stats (void) 
@@ -168,10 +488,184 @@ timer_print_stats (void)
 
 /* Timer interrupt handler. */
 static void
-timer_interrupt (struct intr_frame *args UNUSED)
+timer_interrupt (struct intr_frame *args)
 {
+  if (idle_resync)
+    {
+      idle_resync = false;
+      pit_configure_channel (0, 2, TIMER_FREQ);
+    }
+  seqlock_write_begin (&ticks_seq);
   ticks++;
+  seqlock_write_end (&ticks_seq);
+  profile_sample (args);
   thread_tick ();
+  wheel_advance ();
+}
+
+/* Adds pending timer T to the wheel slot for its expiration
+   tick. */
+static void
+wheel_insert (struct timer *t) 
+{
+  int64_t expires = t->expires;
+  int64_t delta = expires - wheel_next;
+  int level;
+
+  if (delta < 0)
+    {
+      /* Already due: expire at the next tick. */
+      expires = wheel_next;
+      delta = 0;
+    }
+  else if (delta >= WHEEL_SPAN)
+    {
+      /* Beyond the top level: park in its farthest slot, from
+         which the timer will be cascaded and reinserted. */
+      expires = wheel_next + WHEEL_SPAN - 1;
+      delta = WHEEL_SPAN - 1;
+    }
+
+  for (level = 0; delta >= (1 << (WHEEL_BITS * (level + 1))); level++)
+    continue;
+  list_push_back (&wheel[level][(expires >> (WHEEL_BITS * level))
+                                & WHEEL_MASK],
+                  &t->elem);
+}
+
+/* Moves the timers in LEVEL's slot for wheel_next down the
+   hierarchy. */
+static void
+wheel_cascade (int level) 
+{
+  int slot = (wheel_next >> (WHEEL_BITS * level)) & WHEEL_MASK;
+  struct list *l = &wheel[level][slot];
+
+  while (!list_empty (l))
+    wheel_insert (list_entry (list_pop_front (l), struct timer, elem));
+}
+
+/* Expires the wheel's level-0 slots up to the current tick,
+   moving their timers to expired_list and cascading higher
+   levels as level 0 wraps around. */
+static void
+wheel_advance (void) 
+{
+  while (wheel_next <= ticks)
+    {
+      struct list *slot = &wheel[0][wheel_next & WHEEL_MASK];
+      int level;
+
+      for (level = 1; level < WHEEL_LEVELS; level++)
+        {
+          if (((wheel_next >> (WHEEL_BITS * (level - 1)))
+               & WHEEL_MASK) != 0)
+            break;
+          wheel_cascade (level);
+        }
+
+      while (!list_empty (slot))
+        list_push_back (&expired_list, list_pop_front (slot));
+      wheel_next++;
+    }
+}
+
+/* Returns the number of ticks until the wheel next has work to
+   do, either a timer to expire or a cascade, or MAX if that is
+   farther away. */
+static int64_t
+ticks_to_next_timer (int64_t max) 
+{
+  int64_t n;
+
+  if (!list_empty (&expired_list))
+    return 0;
+  for (n = 1; n < max; n++)
+    {
+      int64_t tick = ticks + n;
+      if ((tick & WHEEL_MASK) == 0
+          || !list_empty (&wheel[0][tick & WHEEL_MASK]))
+        break;
+    }
+  return n;
+}
+
+/* Timer callback for timer_sleep() that wakes up THREAD. */
+static void
+wake_sleeper (struct timer *t UNUSED, void *thread) 
+{
+  thread_unblock (thread);
+}
+
+/* Returns true if the CPU has a time-stamp counter.  The CPUID
+   instruction is only available if the ID bit in EFLAGS can be
+   toggled; CPUID function 1 reports the TSC in bit 4 of EDX. */
+static bool
+have_tsc (void) 
+{
+  static int tsc = -1;          /* -1 until probed, then bool. */
+  uint32_t before, after;
+  uint32_t eax, ebx, ecx, edx;
+
+  if (timer_no_tsc)
+    return false;
+  if (tsc >= 0)
+    return tsc;
+
+  asm volatile ("pushfl; popl %0; movl %0, %1; xorl $0x200000, %1; "
+                "pushl %1; popfl; pushfl; popl %1; pushl %0; popfl"
+                : "=&r" (before), "=&r" (after));
+  if (((before ^ after) & 0x200000) == 0)
+    tsc = false;
+  else
+    {
+      asm volatile ("cpuid"
+                    : "=a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx)
+                    : "a" (1));
+      tsc = (edx & (1u << 4)) != 0;
+    }
+  return tsc;
+}
+
+/* Reads the time-stamp counter. */
+static inline int64_t
+rdtsc (void) 
+{
+  uint64_t tsc;
+  asm volatile ("rdtsc" : "=A" (tsc));
+  return tsc;
+}
+
+/* Waits for the next timer tick to begin. */
+static void
+wait_for_tick (void) 
+{
+  int64_t start = ticks;
+  while (ticks == start)
+    barrier ();
+}
+
+/* Calibrates loops_per_tick by timing busy-wait loops against
+   the timer. */
+static void
+calibrate_loops (void) 
+{
+  unsigned high_bit, test_bit;
+
+  /* Approximate loops_per_tick as the largest power-of-two
+     still less than one timer tick. */
+  loops_per_tick = 1u << 10;
+  while (!too_many_loops (loops_per_tick << 1)) 
+    {
+      loops_per_tick <<= 1;
+      ASSERT (loops_per_tick != 0);
+    }
+
+  /* Refine the next 8 bits of loops_per_tick. */
+  high_bit = loops_per_tick;
+  for (test_bit = high_bit >> 1; test_bit != high_bit >> 10; test_bit >>= 1)
+    if (!too_many_loops (high_bit | test_bit))
+      loops_per_tick |= test_bit;
 }
 
 /* Returns true if LOOPS iterations waits for more than one timer
@@ -179,10 +673,10 @@ timer_interrupt (struct intr_frame *args UNUSED)
 static bool
 too_many_loops (unsigned loops) 
 {
+  int64_t start;
+
   /* Wait for a timer tick. */
-  int64_t start = ticks;
-  while (ticks == start)
-    barrier ();
+  wait_for_tick ();
 
   /* Run LOOPS loops. */
   start = ticks;
@@ -242,5 +736,14 @@ real_time_delay (int64_t num, int32_t denom)
   /* Scale the numerator and denominator down by 1000 to avoid
      the possibility of overflow. */
   ASSERT (denom % 1000 == 0);
+  if (cycles_per_tick != 0)
+    {
+      int64_t start = rdtsc ();
+      int64_t cycles = (cycles_per_tick * num / 1000 * TIMER_FREQ
+                        / (denom / 1000));
+      while (rdtsc () - start < cycles)
+        barrier ();
+      return;
+    }
   busy_wait (loops_per_tick * num / 1000 * TIMER_FREQ / (denom / 1000)); 
 }
@@ -1,7 +1,9 @@
 #ifndef DEVICES_TIMER_H
 #define DEVICES_TIMER_H
 
+#include <list.h>
 #include <round.h>
+#include <stdbool.h>
 #include <stdint.h>
 
 /* Number of timer interrupts per second. */
@@ -13,6 +15,11 @@ void timer_calibrate (void);
 int64_t timer_ticks (void);
 int64_t timer_elapsed (int64_t);
 
+/* High-resolution clock. */
+int64_t timer_cycles (void);
+int64_t timer_cycles_to_ns (int64_t cycles);
+int64_t timer_ns (void);
+
 /* Sleep and yield the CPU to other threads. */
 void timer_sleep (int64_t ticks);
 void timer_msleep (int64_t milliseconds);
@@ -24,6 +31,34 @@ void timer_mdelay (int64_t milliseconds);
 void timer_udelay (int64_t microseconds);
 void timer_ndelay (int64_t nanoseconds);
 
+/* Timer callbacks. */
+struct timer;
+typedef void timer_func (struct timer *, void *aux);
+
+/* A timer that calls a function once a given tick has passed. */
+struct timer
+  {
+    struct list_elem elem;      /* Wheel slot or expired list element. */
+    int64_t expires;            /* Timer tick at which to expire. */
+    timer_func *func;           /* Function to call. */
+    void *aux;                  /* Auxiliary data for FUNC. */
+    bool pending;               /* Armed and not yet called? */
+  };
+
+void timer_setup (struct timer *, timer_func *, void *aux);
+void timer_arm (struct timer *, int64_t expires);
+bool timer_cancel (struct timer *);
+bool timer_pending (const struct timer *);
+void timer_run_expired (void);
+
+/* Loop calibration even with a time-stamp counter. */
+extern bool timer_no_tsc;
+
+/* Tickless idle. */
+extern bool timer_tickless;
+void timer_idle_enter (void);
+void timer_idle_exit (void);
+
 void timer_print_stats (void);
 
 #endif /* devices/timer.h */
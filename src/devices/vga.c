@@ -8,16 +8,33 @@
 #include "threads/interrupt.h"
 #include "threads/vaddr.h"
 
-/* VGA text screen support.  See [FREEVGA] for more information. */
+/* VGA text screen support.  See [FREEVGA] for more information.
+
+   The display shows ROW_CNT consecutive rows of a larger buffer
+   of BUF_ROW_CNT rows in video memory, starting at row TOP.  To
+   scroll, we just advance TOP and point the CRT controller's
+   start address at it, instead of copying the screen.  Only when
+   the screen reaches the end of the buffer do we copy it back
+   to the beginning, once every BUF_ROW_CNT - ROW_CNT lines. */
 
 /* Number of columns and rows on the text display. */
 #define COL_CNT 80
 #define ROW_CNT 25
 
+/* Number of rows in the 32 kB of text mode video memory. */
+#define BUF_ROW_CNT (32 * 1024 / (COL_CNT * 2))
+
 /* Current cursor position.  (0,0) is in the upper left corner of
    the display. */
 static size_t cx, cy;
 
+/* Buffer row shown at the top of the display. */
+static size_t top;
+
+/* Start address and cursor position last written to the CRT
+   controller, to avoid rewriting them when they don't change. */
+static uint16_t hw_start, hw_cursor;
+
 /* Attribute value for gray text on a black background. */
 #define GRAY_ON_BLACK 0x07
 
@@ -26,11 +43,12 @@ static size_t cx, cy;
    The attribute at (x,y) is fb[y][x][1]. */
 static uint8_t (*fb)[COL_CNT][2];
 
+static void write_char (int c, enum intr_level old_level);
 static void clear_row (size_t y);
 static void cls (void);
 static void newline (void);
-static void move_cursor (void);
-static void find_cursor (size_t *x, size_t *y);
+static void update_crtc (void);
+static uint16_t read_crtc (uint8_t high_reg);
 
 /* Initializes the VGA text display. */
 static void
@@ -40,8 +58,23 @@ init (void)
   static bool inited;
   if (!inited)
     {
+      uint16_t cp;
+
       fb = ptov (0xb8000);
-      find_cursor (&cx, &cy);
+      hw_start = read_crtc (0x0c);
+      hw_cursor = cp = read_crtc (0x0e);
+      top = hw_start / COL_CNT;
+      if (top > BUF_ROW_CNT - ROW_CNT || cp < top * COL_CNT
+          || cp >= (top + ROW_CNT) * COL_CNT)
+        {
+          /* Not a layout that we would have set up: start over. */
+          cls ();
+        }
+      else
+        {
+          cx = cp % COL_CNT;
+          cy = cp / COL_CNT - top;
+        }
       inited = true; 
     }
 }
@@ -56,7 +89,71 @@ vga_putc (int c)
   enum intr_level old_level = intr_disable ();
 
   init ();
-  
+  write_char (c, old_level);
+
+  /* Update scroll and cursor position. */
+  update_crtc ();
+
+  intr_set_level (old_level);
+}
+
+/* Returns true if C is a control character that vga_putc()
+   interprets, false if it is displayed as is. */
+static bool
+is_control (char c) 
+{
+  return c == '\n' || c == '\f' || c == '\b' || c == '\r' || c == '\t'
+         || c == '\a';
+}
+
+/* Writes the N characters in BUFFER to the VGA text display, as
+   vga_putc() would one at a time.  Each run of ordinary
+   characters within a line is written as a span of cells, and
+   the display's scroll and cursor positions are updated only
+   once, at the end. */
+void
+vga_putbuf (const char *buffer, size_t n) 
+{
+  enum intr_level old_level = intr_disable ();
+
+  init ();
+  while (n > 0) 
+    {
+      size_t run = 0;
+
+      while (run < n && run < COL_CNT - cx && !is_control (buffer[run]))
+        {
+          fb[top + cy][cx + run][0] = buffer[run];
+          fb[top + cy][cx + run][1] = GRAY_ON_BLACK;
+          run++;
+        }
+
+      if (run > 0)
+        {
+          cx += run;
+          if (cx >= COL_CNT)
+            newline ();
+        }
+      else
+        {
+          write_char (*buffer, old_level);
+          run = 1;
+        }
+      buffer += run;
+      n -= run;
+    }
+  update_crtc ();
+
+  intr_set_level (old_level);
+}
+
+/* Writes C to the VGA text display at the cursor, interpreting
+   control characters, without moving the hardware cursor.
+   Interrupts must be off.  OLD_LEVEL is the interrupt level to
+   restore while beeping the speaker for '\a'. */
+static void
+write_char (int c, enum intr_level old_level) 
+{
   switch (c) 
     {
     case '\n':
@@ -89,33 +186,29 @@ vga_putc (int c)
       break;
       
     default:
-      fb[cy][cx][0] = c;
-      fb[cy][cx][1] = GRAY_ON_BLACK;
+      fb[top + cy][cx][0] = c;
+      fb[top + cy][cx][1] = GRAY_ON_BLACK;
       if (++cx >= COL_CNT)
         newline ();
       break;
     }
-
-  /* Update cursor position. */
-  move_cursor ();
-
-  intr_set_level (old_level);
 }
-
+
 /* Clears the screen and moves the cursor to the upper left. */
 static void
 cls (void)
 {
   size_t y;
 
+  top = 0;
   for (y = 0; y < ROW_CNT; y++)
     clear_row (y);
 
   cx = cy = 0;
-  move_cursor ();
+  update_crtc ();
 }
 
-/* Clears row Y to spaces. */
+/* Clears buffer row Y to spaces. */
 static void
 clear_row (size_t y) 
 {
@@ -130,7 +223,8 @@ clear_row (size_t y)
 
 /* Advances the cursor to the first column in the next line on
    the screen.  If the cursor is already on the last line on the
-   screen, scrolls the screen upward one line. */
+   screen, scrolls the screen upward one line.  The display
+   itself changes at the next update_crtc(). */
 static void
 newline (void)
 {
@@ -139,34 +233,56 @@ newline (void)
   if (cy >= ROW_CNT)
     {
       cy = ROW_CNT - 1;
-      memmove (&fb[0], &fb[1], sizeof fb[0] * (ROW_CNT - 1));
-      clear_row (ROW_CNT - 1);
+      if (top + ROW_CNT < BUF_ROW_CNT)
+        top++;
+      else
+        {
+          /* Out of buffer: copy the rows to stay on screen back to
+             the beginning. */
+          memmove (&fb[0], &fb[top + 1], sizeof fb[0] * (ROW_CNT - 1));
+          top = 0;
+        }
+      clear_row (top + ROW_CNT - 1);
     }
 }
 
-/* Moves the hardware cursor to (cx,cy). */
+/* Points the CRT controller's start address at row TOP and moves
+   the hardware cursor to (cx,cy), if they have changed.  See
+   [FREEVGA] under "CRTC Registers" and "Manipulating the
+   Text-mode Cursor". */
 static void
-move_cursor (void) 
+update_crtc (void) 
 {
-  /* See [FREEVGA] under "Manipulating the Text-mode Cursor". */
-  uint16_t cp = cx + COL_CNT * cy;
-  outw (0x3d4, 0x0e | (cp & 0xff00));
-  outw (0x3d4, 0x0f | (cp << 8));
+  uint16_t start = top * COL_CNT;
+  uint16_t cp = start + cy * COL_CNT + cx;
+
+  if (start != hw_start)
+    {
+      outw (0x3d4, 0x0c | (start & 0xff00));
+      outw (0x3d4, 0x0d | (start << 8));
+      hw_start = start;
+    }
+  if (cp != hw_cursor)
+    {
+      outw (0x3d4, 0x0e | (cp & 0xff00));
+      outw (0x3d4, 0x0f | (cp << 8));
+      hw_cursor = cp;
+    }
 }
 
-/* Reads the current hardware cursor position into (*X,*Y). */
-static void
-find_cursor (size_t *x, size_t *y) 
+/* Reads the 16-bit CRT controller value whose high byte is in
+   register HIGH_REG and whose low byte is in the next
+   register. */
+static uint16_t
+read_crtc (uint8_t high_reg) 
 {
-  /* See [FREEVGA] under "Manipulating the Text-mode Cursor". */
-  uint16_t cp;
+  uint16_t value;
 
-  outb (0x3d4, 0x0e);
-  cp = inb (0x3d5) << 8;
+  outb (0x3d4, high_reg);
+  value = inb (0x3d5) << 8;
 
-  outb (0x3d4, 0x0f);
-  cp |= inb (0x3d5);
+  outb (0x3d4, high_reg + 1);
+  value |= inb (0x3d5);
 
-  *x = cp % COL_CNT;
-  *y = cp / COL_CNT;
+  return value;
 }
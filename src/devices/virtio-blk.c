@@ -0,0 +1,559 @@
+#include "devices/virtio-blk.h"
+#include <debug.h>
+#include <round.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/block.h"
+#include "devices/partition.h"
+#include "devices/pci.h"
+#include "threads/interrupt.h"
+#include "threads/io.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+#include "threads/workqueue.h"
+
+/* The code in this file is an interface to virtio block devices
+   ("virtio-blk"), as emulated by QEMU with "-drive if=virtio".
+   It uses the legacy PCI interface described in [VIRTIO].
+
+   Requests are placed on a single virtqueue shared with the
+   device, and any number of them may be in flight at once,
+   limited only by the size of the queue.  A request made through
+   the synchronous operations sleeps until the interrupt handler
+   finds it on the used ring.  A transfer started by the block
+   layer through virtio_blk_submit() returns as soon as it is on
+   the queue and is finished with block_complete(), so that the
+   block layer can keep several transfers outstanding. */
+
+/* PCI IDs of a (transitional) virtio block device. */
+#define VIRTIO_VENDOR 0x1af4
+#define VIRTIO_BLK_DEVICE 0x1001
+
+/* Legacy virtio I/O port addresses, relative to BAR0. */
+#define reg_host_features(D) ((D)->reg_base + 0x00)  /* Device features. */
+#define reg_guest_features(D) ((D)->reg_base + 0x04) /* Driver features. */
+#define reg_queue_pfn(D) ((D)->reg_base + 0x08)      /* Queue page frame. */
+#define reg_queue_size(D) ((D)->reg_base + 0x0c)     /* Queue size (r/o). */
+#define reg_queue_select(D) ((D)->reg_base + 0x0e)   /* Queue select. */
+#define reg_queue_notify(D) ((D)->reg_base + 0x10)   /* Queue notify. */
+#define reg_status(D) ((D)->reg_base + 0x12)         /* Device status. */
+#define reg_isr(D) ((D)->reg_base + 0x13)            /* ISR status. */
+#define reg_capacity(D) ((D)->reg_base + 0x14)       /* Capacity, 64 bits. */
+
+/* Device status bits. */
+#define STATUS_ACKNOWLEDGE 0x01 /* Guest has noticed the device. */
+#define STATUS_DRIVER 0x02      /* Guest knows how to drive it. */
+#define STATUS_DRIVER_OK 0x04   /* Driver is ready. */
+#define STATUS_FAILED 0x80      /* Driver gave up on the device. */
+
+/* ISR status bits.  Reading the register clears them. */
+#define ISR_QUEUE 0x01          /* Used ring was updated. */
+
+/* Virtqueue descriptor. */
+struct vring_desc
+  {
+    uint64_t addr;              /* Physical address of buffer. */
+    uint32_t len;               /* Length of buffer in bytes. */
+    uint16_t flags;             /* VRING_DESC_F_* flags. */
+    uint16_t next;              /* Next descriptor, if F_NEXT. */
+  };
+#define VRING_DESC_F_NEXT 1     /* Chain continues in NEXT. */
+#define VRING_DESC_F_WRITE 2    /* Device writes, rather than reads. */
+
+/* Ring of descriptor chains offered to the device. */
+struct vring_avail
+  {
+    uint16_t flags;
+    uint16_t idx;               /* Where the driver puts the next entry. */
+    uint16_t ring[];            /* Heads of descriptor chains. */
+  };
+
+/* Ring of descriptor chains returned by the device. */
+struct vring_used_elem
+  {
+    uint32_t id;                /* Head of descriptor chain. */
+    uint32_t len;               /* Bytes written into the chain. */
+  };
+struct vring_used
+  {
+    uint16_t flags;
+    uint16_t idx;               /* Where the device puts the next entry. */
+    struct vring_used_elem ring[];
+  };
+
+/* Request header, read by the device. */
+struct virtio_blk_outhdr
+  {
+    uint32_t type;              /* VIRTIO_BLK_T_*. */
+    uint32_t ioprio;            /* Unused. */
+    uint64_t sector;            /* First sector. */
+  };
+#define VIRTIO_BLK_T_IN 0       /* Read. */
+#define VIRTIO_BLK_T_OUT 1      /* Write. */
+
+/* A request in flight. */
+struct virtio_req
+  {
+    struct virtio_blk_outhdr hdr;       /* Header for the device. */
+    uint8_t status;                     /* Written by the device, 0=OK. */
+    struct block_xfer *xfer;            /* Block layer transfer, or null
+                                           if a thread waits on DONE. */
+    struct semaphore done;              /* Up'd on completion. */
+  };
+
+/* A virtio block device. */
+struct virtio_blk
+  {
+    char name[8];               /* Name, e.g. "vda". */
+    uint16_t reg_base;          /* Base I/O port. */
+    uint8_t irq;                /* Interrupt vector. */
+
+    /* Virtqueue, in physically contiguous pages shared with the
+       device.  Protected by disabling interrupts, because the
+       submit path can run while a worker thread is completing
+       requests. */
+    uint16_t queue_size;        /* Number of descriptors. */
+    struct vring_desc *desc;    /* Descriptor table. */
+    struct vring_avail *avail;  /* Available ring. */
+    struct vring_used *used;    /* Used ring. */
+    uint16_t last_used;         /* Used ring entries already processed. */
+    uint16_t free_head;         /* First free descriptor. */
+    uint16_t free_cnt;          /* Number of free descriptors. */
+    struct virtio_req **reqs;   /* Request for each chain head. */
+    struct virtio_req *xfer_reqs; /* Storage for block layer transfers'
+                                     requests, by chain head. */
+
+    /* Submitters wait here, one at a time, for descriptors. */
+    struct lock submit_lock;    /* Held while waiting for descriptors. */
+    struct semaphore desc_freed; /* Up'd when descriptors are freed. */
+    bool desc_wanted;           /* True if a submitter is waiting. */
+
+    /* Queued by the interrupt handler to complete requests. */
+    struct work complete_work;
+  };
+
+/* Virtio block devices, in probe order. */
+#define MAX_DEVICES 4
+static struct virtio_blk *devices[MAX_DEVICES];
+static size_t device_cnt;
+
+static struct block_operations virtio_blk_operations;
+
+static bool init_device (struct virtio_blk *, const struct pci_addr *);
+static bool init_queue (struct virtio_blk *);
+static void interrupt_handler (struct intr_frame *);
+static work_func complete_work;
+
+/* Finds and initializes virtio block devices. */
+void
+virtio_blk_init (void)
+{
+  struct pci_addr addr;
+  int idx;
+
+  for (idx = 0; device_cnt < MAX_DEVICES
+         && pci_find_device (VIRTIO_VENDOR, VIRTIO_BLK_DEVICE, idx, &addr);
+       idx++)
+    {
+      struct virtio_blk *d = calloc (1, sizeof *d);
+      if (d == NULL)
+        PANIC ("Failed to allocate memory for virtio block device");
+
+      snprintf (d->name, sizeof d->name, "vd%c", 'a' + (int) device_cnt);
+      if (!init_device (d, &addr))
+        {
+          printf ("%s: initialization failed\n", d->name);
+          free (d);
+        }
+    }
+}
+
+/* Sets up virtio block device D, found at ADDR, and registers it
+   with the block layer.  Returns true if successful. */
+static bool
+init_device (struct virtio_blk *d, const struct pci_addr *addr)
+{
+  uint32_t bar0, cmd;
+  uint64_t capacity;
+  struct block *block;
+  intr_handler_func *handler;
+
+  bar0 = pci_read_config (addr, PCI_REG_BAR0);
+  if ((bar0 & 1) == 0)
+    return false;
+  d->reg_base = bar0 & 0xfffc;
+  d->irq = (pci_read_config (addr, PCI_REG_IRQ) & 0xff) + 0x20;
+  if (d->irq < 0x20 || d->irq > 0x2f)
+    return false;
+
+  /* Virtio devices may share a line with each other, but not
+     with other drivers, whose handlers do not expect to be called
+     for our interrupts and which intr_register_ext() would not
+     chain to anyway. */
+  handler = intr_get_handler (d->irq);
+  if (handler != NULL && handler != interrupt_handler)
+    {
+      printf ("%s: IRQ %d already used by %s\n",
+              d->name, d->irq - 0x20, intr_name (d->irq));
+      return false;
+    }
+
+  cmd = pci_read_config (addr, PCI_REG_CMD) & 0xffff;
+  pci_write_config (addr, PCI_REG_CMD, cmd | PCI_CMD_IO | PCI_CMD_MASTER);
+
+  /* Reset the device and tell it we know how to drive it.  We
+     need none of its optional features. */
+  outb (reg_status (d), 0);
+  outb (reg_status (d), STATUS_ACKNOWLEDGE);
+  outb (reg_status (d), STATUS_ACKNOWLEDGE | STATUS_DRIVER);
+  outl (reg_guest_features (d), 0);
+
+  if (!init_queue (d))
+    {
+      outb (reg_status (d), STATUS_FAILED);
+      return false;
+    }
+
+  /* Register the interrupt handler, once per vector, since
+     several devices may share a line. */
+  if (handler == NULL)
+    intr_register_ext (d->irq, interrupt_handler, "virtio-blk");
+  devices[device_cnt++] = d;
+
+  outb (reg_status (d),
+        STATUS_ACKNOWLEDGE | STATUS_DRIVER | STATUS_DRIVER_OK);
+
+  /* Register. */
+  capacity = inl (reg_capacity (d)) | ((uint64_t) inl (reg_capacity (d) + 4)
+                                       << 32);
+  if (capacity > (block_sector_t) -1)
+    capacity = (block_sector_t) -1;
+  block = block_register (d->name, BLOCK_RAW, "virtio", capacity,
+                          &virtio_blk_operations, d);
+  partition_scan (block);
+  return true;
+}
+
+/* Allocates and initializes queue 0 of device D, the only queue
+   that a virtio block device has.  Returns true if
+   successful. */
+static bool
+init_queue (struct virtio_blk *d)
+{
+  size_t n, avail_ofs, used_ofs, size;
+  uint8_t *queue;
+  size_t i;
+
+  outw (reg_queue_select (d), 0);
+  n = inw (reg_queue_size (d));
+  if (n == 0)
+    return false;
+
+  /* Legacy layout: descriptor table, then the available ring,
+     then, at the next page boundary, the used ring. */
+  avail_ofs = n * sizeof (struct vring_desc);
+  used_ofs = ROUND_UP (avail_ofs + sizeof (uint16_t) * (3 + n), PGSIZE);
+  size = used_ofs + (sizeof (uint16_t) * 3
+                     + sizeof (struct vring_used_elem) * n);
+  queue = palloc_get_multiple (PAL_ZERO, DIV_ROUND_UP (size, PGSIZE));
+  d->reqs = calloc (n, sizeof *d->reqs);
+  d->xfer_reqs = calloc (n, sizeof *d->xfer_reqs);
+  if (queue == NULL || d->reqs == NULL || d->xfer_reqs == NULL)
+    {
+      if (queue != NULL)
+        palloc_free_multiple (queue, DIV_ROUND_UP (size, PGSIZE));
+      free (d->reqs);
+      free (d->xfer_reqs);
+      return false;
+    }
+
+  d->queue_size = n;
+  d->desc = (struct vring_desc *) queue;
+  d->avail = (struct vring_avail *) (queue + avail_ofs);
+  d->used = (struct vring_used *) (queue + used_ofs);
+  d->last_used = 0;
+
+  /* Chain all of the descriptors onto the free list. */
+  for (i = 0; i + 1 < n; i++)
+    d->desc[i].next = i + 1;
+  d->free_head = 0;
+  d->free_cnt = n;
+
+  lock_init (&d->submit_lock);
+  work_init (&d->complete_work, complete_work, d);
+  sema_init (&d->desc_freed, 0);
+  d->desc_wanted = false;
+
+  outl (reg_queue_pfn (d), vtop (queue) >> PGBITS);
+  return true;
+}
+
+/* Takes a descriptor off D's free list, fills it in with the
+   SIZE bytes at kernel address BUF and FLAGS, and links it to
+   PREV, if PREV is not -1.  Returns the descriptor's index.
+   Interrupts must be off. */
+static uint16_t
+add_desc (struct virtio_blk *d, int prev, const void *buf, size_t size,
+          uint16_t flags)
+{
+  uint16_t idx = d->free_head;
+  struct vring_desc *desc = &d->desc[idx];
+
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (d->free_cnt > 0);
+
+  d->free_head = desc->next;
+  d->free_cnt--;
+
+  desc->addr = vtop (buf);
+  desc->len = size;
+  desc->flags = flags;
+  if (prev >= 0)
+    {
+      d->desc[prev].flags |= VRING_DESC_F_NEXT;
+      d->desc[prev].next = idx;
+    }
+  return idx;
+}
+
+/* Waits for enough free descriptors on D, then offers the device
+   a request to transfer the sectors starting at SECTOR between D
+   and the IOV_CNT buffers in IOV, reading from the device if
+   WRITE is false, writing if it is true.  The request is REQ, or,
+   if REQ is null, D's storage for the chain's head, set up to
+   finish transfer X.  IOV_CNT + 2 must not exceed the queue
+   size. */
+static void
+enqueue (struct virtio_blk *d, struct virtio_req *req,
+         struct block_xfer *x, block_sector_t sector,
+         const struct block_iovec *iov, size_t iov_cnt, bool write)
+{
+  enum intr_level old_level;
+  uint16_t head;
+  int prev;
+  size_t i;
+
+  ASSERT (iov_cnt + 2 <= d->queue_size);
+
+  /* Wait for enough free descriptors. */
+  lock_acquire (&d->submit_lock);
+  old_level = intr_disable ();
+  while (d->free_cnt < iov_cnt + 2)
+    {
+      d->desc_wanted = true;
+      intr_set_level (old_level);
+      sema_down (&d->desc_freed);
+      old_level = intr_disable ();
+    }
+
+  /* add_desc() takes the free list's head first, so it will be
+     the head of this request's chain. */
+  if (req == NULL)
+    req = &d->xfer_reqs[d->free_head];
+  req->hdr.type = write ? VIRTIO_BLK_T_OUT : VIRTIO_BLK_T_IN;
+  req->hdr.ioprio = 0;
+  req->hdr.sector = sector;
+  req->status = 0xff;
+  req->xfer = x;
+
+  /* Build the descriptor chain and offer it to the device. */
+  head = prev = add_desc (d, -1, &req->hdr, sizeof req->hdr, 0);
+  for (i = 0; i < iov_cnt; i++)
+    prev = add_desc (d, prev, iov[i].base, iov[i].len,
+                     write ? 0 : VRING_DESC_F_WRITE);
+  add_desc (d, prev, &req->status, 1, VRING_DESC_F_WRITE);
+  d->reqs[head] = req;
+
+  d->avail->ring[d->avail->idx % d->queue_size] = head;
+  barrier ();
+  d->avail->idx++;
+  barrier ();
+  outw (reg_queue_notify (d), 0);
+  intr_set_level (old_level);
+  lock_release (&d->submit_lock);
+}
+
+/* Transfers the sectors starting at SECTOR between D and the
+   IOV_CNT buffers in IOV, reading from the device if WRITE is
+   false, writing if it is true, and sleeps until the device
+   completes the request. */
+static void
+transfer (struct virtio_blk *d, block_sector_t sector,
+          const struct block_iovec *iov, size_t iov_cnt, bool write)
+{
+  struct virtio_req req;
+  size_t i;
+
+  /* A request needs a descriptor for the header, one per buffer,
+     and one for the status byte.  Split requests too big for
+     the queue. */
+  if (iov_cnt + 2 > d->queue_size)
+    {
+      for (i = 0; i < iov_cnt; i++)
+        {
+          transfer (d, sector, &iov[i], 1, write);
+          sector += iov[i].len / BLOCK_SECTOR_SIZE;
+        }
+      return;
+    }
+
+  sema_init (&req.done, 0);
+  enqueue (d, &req, NULL, sector, iov, iov_cnt, write);
+
+  /* Sleep until the interrupt handler sees the request done. */
+  sema_down (&req.done);
+  if (req.status != 0)
+    PANIC ("%s: disk %s failed, sector=%"PRDSNu", status=%d",
+           d->name, write ? "write" : "read", sector, req.status);
+}
+
+/* Reads sector SECTOR from device D into BUFFER, which must have
+   room for BLOCK_SECTOR_SIZE bytes. */
+static void
+virtio_blk_read (void *d_, block_sector_t sector, void *buffer)
+{
+  struct block_iovec iov;
+
+  iov.base = buffer;
+  iov.len = BLOCK_SECTOR_SIZE;
+  transfer (d_, sector, &iov, 1, false);
+}
+
+/* Writes sector SECTOR to device D from BUFFER, which must
+   contain BLOCK_SECTOR_SIZE bytes.  Returns after the device has
+   completed the write. */
+static void
+virtio_blk_write (void *d_, block_sector_t sector, const void *buffer)
+{
+  struct block_iovec iov;
+
+  iov.base = (void *) buffer;
+  iov.len = BLOCK_SECTOR_SIZE;
+  transfer (d_, sector, &iov, 1, true);
+}
+
+/* Reads consecutive sectors starting at SECTOR from device D
+   into the IOV_CNT buffers in IOV, as a single request. */
+static void
+virtio_blk_read_multi (void *d_, block_sector_t sector,
+                       const struct block_iovec *iov, size_t iov_cnt)
+{
+  transfer (d_, sector, iov, iov_cnt, false);
+}
+
+/* Writes consecutive sectors starting at SECTOR to device D from
+   the IOV_CNT buffers in IOV, as a single request. */
+static void
+virtio_blk_write_multi (void *d_, block_sector_t sector,
+                        const struct block_iovec *iov, size_t iov_cnt)
+{
+  transfer (d_, sector, iov, iov_cnt, true);
+}
+
+/* Starts transfer X on device D and returns as soon as the
+   device has it, unless X has too many buffers for the queue, in
+   which case it is done synchronously.  Either way, X is finished
+   with block_complete().  May sleep until descriptors are
+   free. */
+static void
+virtio_blk_submit (void *d_, struct block_xfer *x)
+{
+  struct virtio_blk *d = d_;
+
+  if (x->iov_cnt + 2 <= d->queue_size)
+    enqueue (d, NULL, x, x->sector, x->iov, x->iov_cnt, x->write);
+  else
+    {
+      transfer (d, x->sector, x->iov, x->iov_cnt, x->write);
+      block_complete (x);
+    }
+}
+
+static struct block_operations virtio_blk_operations =
+  {
+    virtio_blk_read,
+    virtio_blk_write,
+    virtio_blk_read_multi,
+    virtio_blk_write_multi,
+    virtio_blk_submit
+  };
+
+/* Completes the requests that device D has returned on its used
+   ring, freeing their descriptors and waking their threads or
+   finishing their block layer transfers.  Must be called by a
+   thread, with interrupts off. */
+static void
+complete_requests (struct virtio_blk *d)
+{
+  bool freed = false;
+
+  while (d->last_used != d->used->idx)
+    {
+      struct vring_used_elem *e;
+      struct virtio_req *req;
+      uint16_t idx, head;
+
+      barrier ();
+      e = &d->used->ring[d->last_used % d->queue_size];
+      head = e->id;
+
+      /* Return the chain to the free list. */
+      for (idx = head; d->desc[idx].flags & VRING_DESC_F_NEXT;
+           idx = d->desc[idx].next)
+        d->free_cnt++;
+      d->desc[idx].next = d->free_head;
+      d->free_head = head;
+      d->free_cnt++;
+      freed = true;
+
+      req = d->reqs[head];
+      d->reqs[head] = NULL;
+      d->last_used++;
+      if (req->xfer == NULL)
+        sema_up (&req->done);
+      else
+        {
+          if (req->status != 0)
+            PANIC ("%s: disk %s failed, sector=%"PRDSNu", status=%d",
+                   d->name, req->xfer->write ? "write" : "read",
+                   req->xfer->sector, req->status);
+          block_complete (req->xfer);
+        }
+    }
+
+  if (freed && d->desc_wanted)
+    {
+      d->desc_wanted = false;
+      sema_up (&d->desc_freed);
+    }
+}
+
+/* Virtio block interrupt handler. */
+static void
+interrupt_handler (struct intr_frame *f)
+{
+  size_t i;
+
+  for (i = 0; i < device_cnt; i++)
+    {
+      struct virtio_blk *d = devices[i];
+
+      /* Reading the ISR acknowledges the interrupt. */
+      if (d->irq == f->vec_no && (inb (reg_isr (d)) & ISR_QUEUE) != 0)
+        work_queue (&d->complete_work, WORK_HIGH);
+    }
+}
+
+/* Worker thread function that completes the requests on device
+   D_'s used ring, after an interrupt. */
+static void
+complete_work (struct work *w UNUSED, void *d_)
+{
+  struct virtio_blk *d = d_;
+  enum intr_level old_level = intr_disable ();
+  complete_requests (d);
+  intr_set_level (old_level);
+}
@@ -6,10 +6,15 @@
 #include "filesys/free-map.h"
 #include "filesys/inode.h"
 #include "filesys/directory.h"
+#include "filesys/journal.h"
 
 /* Partition that contains the file system. */
 struct block *fs_device;
 
+/* Number of sectors that adding or removing a directory entry
+   can log.  An entry may straddle two sectors. */
+#define DIR_ENTRY_SECTORS 2
+
 static void do_format (void);
 
 /* Initializes the file system module.
@@ -23,10 +28,12 @@ filesys_init (bool format)
 
   inode_init ();
   free_map_init ();
+  journal_init ();
 
   if (format) 
     do_format ();
 
+  journal_open ();
   free_map_open ();
 }
 
@@ -36,6 +43,7 @@ void
 filesys_done (void) 
 {
   free_map_close ();
+  journal_done ();
 }
 
 /* Creates a file named NAME with the given INITIAL_SIZE.
@@ -46,14 +54,21 @@ bool
 filesys_create (const char *name, off_t initial_size) 
 {
   block_sector_t inode_sector = 0;
-  struct dir *dir = dir_open_root ();
-  bool success = (dir != NULL
-                  && free_map_allocate (1, &inode_sector)
-                  && inode_create (inode_sector, initial_size)
-                  && dir_add (dir, name, inode_sector));
+  struct dir *dir;
+  bool success;
+
+  if (!journal_begin (DIR_ENTRY_SECTORS
+                      + inode_journal_sectors (initial_size)))
+    return false;
+  dir = dir_open_root ();
+  success = (dir != NULL
+             && free_map_allocate (1, &inode_sector)
+             && inode_create (inode_sector, initial_size)
+             && dir_add (dir, name, inode_sector));
   if (!success && inode_sector != 0) 
     free_map_release (inode_sector, 1);
   dir_close (dir);
+  journal_end ();
 
   return success;
 }
@@ -83,8 +98,24 @@ filesys_open (const char *name)
 bool
 filesys_remove (const char *name) 
 {
-  struct dir *dir = dir_open_root ();
-  bool success = dir != NULL && dir_remove (dir, name);
+  struct dir *dir;
+  struct inode *inode = NULL;
+  off_t length = 0;
+  bool success = false;
+
+  /* The transaction has to be big enough to free the file's
+     data, if this turns out to be its last reference. */
+  dir = dir_open_root ();
+  if (dir != NULL && dir_lookup (dir, name, &inode))
+    {
+      length = inode_length (inode);
+      inode_close (inode);
+      if (journal_begin (DIR_ENTRY_SECTORS + inode_journal_sectors (length)))
+        {
+          success = dir_remove (dir, name);
+          journal_end ();
+        }
+    }
   dir_close (dir); 
 
   return success;
@@ -98,6 +129,7 @@ do_format (void)
   free_map_create ();
   if (!dir_create (ROOT_DIR_SECTOR, 16))
     PANIC ("root directory creation failed");
+  journal_create ();
   free_map_close ();
   printf ("done.\n");
 }
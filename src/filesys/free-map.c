@@ -1,13 +1,23 @@
 #include "filesys/free-map.h"
 #include <bitmap.h>
 #include <debug.h>
+#include <round.h>
 #include "filesys/file.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
+#include "filesys/journal.h"
 
 static struct file *free_map_file;   /* Free map file. */
 static struct bitmap *free_map;      /* Free map, one bit per sector. */
 
+/* Sectors that have been freed but may not be reused yet,
+   because the journal still holds an older copy of them that
+   replay after a crash would write back over their new
+   contents.  Cleared by free_map_checkpoint(). */
+static struct bitmap *held_map;
+
+static bool write_range (block_sector_t, size_t cnt);
+
 /* Initializes the free map. */
 void
 free_map_init (void) 
@@ -15,8 +25,12 @@ free_map_init (void)
   free_map = bitmap_create (block_size (fs_device));
   if (free_map == NULL)
     PANIC ("bitmap creation failed--file system device is too large");
+  held_map = bitmap_create (block_size (fs_device));
+  if (held_map == NULL)
+    PANIC ("bitmap creation failed--file system device is too large");
   bitmap_mark (free_map, FREE_MAP_SECTOR);
   bitmap_mark (free_map, ROOT_DIR_SECTOR);
+  bitmap_mark (free_map, JOURNAL_SECTOR);
 }
 
 /* Allocates CNT consecutive sectors from the free map and stores
@@ -27,13 +41,23 @@ free_map_init (void)
 bool
 free_map_allocate (size_t cnt, block_sector_t *sectorp)
 {
-  block_sector_t sector = bitmap_scan_and_flip (free_map, 0, cnt, false);
-  if (sector != BITMAP_ERROR
-      && free_map_file != NULL
-      && !bitmap_write (free_map, free_map_file))
+  block_sector_t sector = 0;
+
+  for (;;)
     {
-      bitmap_set_multiple (free_map, sector, cnt, false); 
-      sector = BITMAP_ERROR;
+      sector = bitmap_scan (free_map, sector, cnt, false);
+      if (sector == BITMAP_ERROR || !bitmap_any (held_map, sector, cnt))
+        break;
+      sector++;
+    }
+  if (sector != BITMAP_ERROR)
+    {
+      bitmap_set_multiple (free_map, sector, cnt, true);
+      if (!write_range (sector, cnt))
+        {
+          bitmap_set_multiple (free_map, sector, cnt, false); 
+          sector = BITMAP_ERROR;
+        }
     }
   if (sector != BITMAP_ERROR)
     *sectorp = sector;
@@ -44,9 +68,32 @@ free_map_allocate (size_t cnt, block_sector_t *sectorp)
 void
 free_map_release (block_sector_t sector, size_t cnt)
 {
+  size_t i;
+
   ASSERT (bitmap_all (free_map, sector, cnt));
   bitmap_set_multiple (free_map, sector, cnt, false);
-  bitmap_write (free_map, free_map_file);
+  if (journal_holds (sector, cnt))
+    for (i = 0; i < cnt; i++)
+      if (journal_holds (sector + i, 1))
+        bitmap_mark (held_map, sector + i);
+  write_range (sector, cnt);
+}
+
+/* Makes every sector freed since the last call available for
+   reuse.  Called by the journal once a checkpoint has written
+   all the sectors it held to their home locations. */
+void
+free_map_checkpoint (void)
+{
+  bitmap_set_all (held_map, false);
+}
+
+/* Returns the number of free map sectors that allocating or
+   releasing a run of CNT sectors can write. */
+size_t
+free_map_journal_sectors (size_t cnt)
+{
+  return cnt > 0 ? DIV_ROUND_UP (cnt, BLOCK_SECTOR_SIZE * 8) + 1 : 0;
 }
 
 /* Opens the free map file and reads it from disk. */
@@ -83,3 +130,13 @@ free_map_create (void)
   if (!bitmap_write (free_map, free_map_file))
     PANIC ("can't write free map");
 }
+
+/* Writes the part of the free map covering the CNT sectors
+   starting at SECTOR to the free map file, if it is open.
+   Returns true if successful, false otherwise. */
+static bool
+write_range (block_sector_t sector, size_t cnt)
+{
+  return (free_map_file == NULL
+          || bitmap_write_range (free_map, free_map_file, sector, cnt));
+}
@@ -13,5 +13,7 @@ void free_map_close (void);
 
 bool free_map_allocate (size_t, block_sector_t *);
 void free_map_release (block_sector_t, size_t);
+void free_map_checkpoint (void);
+size_t free_map_journal_sectors (size_t);
 
 #endif /* filesys/free-map.h */
@@ -1,5 +1,6 @@
 #include "filesys/fsutil.h"
 #include <debug.h>
+#include <round.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -7,6 +8,8 @@
 #include "filesys/directory.h"
 #include "filesys/file.h"
 #include "filesys/filesys.h"
+#include "devices/timer.h"
+#include "threads/interrupt.h"
 #include "threads/malloc.h"
 #include "threads/palloc.h"
 #include "threads/vaddr.h"
@@ -66,6 +69,10 @@ fsutil_rm (char **argv)
     PANIC ("%s: delete failed\n", file_name);
 }
 
+/* Number of sectors fsutil_extract() reads from the scratch
+   device per request. */
+#define EXTRACT_SECTORS 16
+
 /* Extracts a ustar-format tar archive from the scratch block
    device into the Pintos file system. */
 void
@@ -78,7 +85,7 @@ fsutil_extract (char **argv UNUSED)
 
   /* Allocate buffers. */
   header = malloc (BLOCK_SECTOR_SIZE);
-  data = malloc (BLOCK_SECTOR_SIZE);
+  data = malloc (EXTRACT_SECTORS * BLOCK_SECTOR_SIZE);
   if (header == NULL || data == NULL)
     PANIC ("couldn't allocate buffers");
 
@@ -126,10 +133,15 @@ fsutil_extract (char **argv UNUSED)
           /* Do copy. */
           while (size > 0)
             {
-              int chunk_size = (size > BLOCK_SECTOR_SIZE
-                                ? BLOCK_SECTOR_SIZE
+              int chunk_size = (size > EXTRACT_SECTORS * BLOCK_SECTOR_SIZE
+                                ? EXTRACT_SECTORS * BLOCK_SECTOR_SIZE
                                 : size);
-              block_read (src, sector++, data);
+              struct block_iovec iov;
+
+              iov.base = data;
+              iov.len = ROUND_UP (chunk_size, BLOCK_SECTOR_SIZE);
+              block_read_multi (src, sector, &iov, 1);
+              sector += iov.len / BLOCK_SECTOR_SIZE;
               if (file_write (dst, data, chunk_size) != chunk_size)
                 PANIC ("%s: write failed with %d bytes unwritten",
                        file_name, size);
@@ -154,6 +166,331 @@ fsutil_extract (char **argv UNUSED)
   free (header);
 }
 
+/* Measures raw read throughput and average request latency of
+   the scratch block device by reading all of it sequentially,
+   ARGV[1] sectors per request. */
+void
+fsutil_bench (char **argv) 
+{
+  int chunk_sectors = atoi (argv[1]);
+  struct block *src;
+  struct block_iovec iov;
+  block_sector_t sector, size;
+  int64_t start, ticks;
+  uint64_t bytes;
+  unsigned req_cnt = 0;
+
+  if (chunk_sectors <= 0)
+    PANIC ("%s: sectors per request must be positive", argv[1]);
+
+  src = block_get_role (BLOCK_SCRATCH);
+  if (src == NULL)
+    PANIC ("couldn't open scratch device");
+  size = block_size (src);
+
+  iov.base = malloc (chunk_sectors * BLOCK_SECTOR_SIZE);
+  if (iov.base == NULL)
+    PANIC ("couldn't allocate buffer");
+
+  printf ("Reading scratch device %s, %d sectors per request...\n",
+          block_name (src), chunk_sectors);
+  start = timer_ticks ();
+  for (sector = 0; sector < size; sector += iov.len / BLOCK_SECTOR_SIZE)
+    {
+      block_sector_t left = size - sector;
+      iov.len = ((left < (block_sector_t) chunk_sectors
+                  ? left : (block_sector_t) chunk_sectors)
+                 * BLOCK_SECTOR_SIZE);
+      block_read_multi (src, sector, &iov, 1);
+      req_cnt++;
+    }
+  ticks = timer_elapsed (start);
+
+  bytes = (uint64_t) size * BLOCK_SECTOR_SIZE;
+  printf ("Read ");
+  print_human_readable_size (bytes);
+  printf (" in %"PRId64" ticks", ticks);
+  if (ticks > 0)
+    printf (" (%"PRIu64" kB/s)", bytes * TIMER_FREQ / ticks / 1024);
+  printf (", %u requests", req_cnt);
+  if (req_cnt > 0)
+    printf (" (%"PRId64" us/request)",
+            ticks * (1000000 / TIMER_FREQ) / req_cnt);
+  printf (".\n");
+
+  free (iov.base);
+}
+
+/* Sectors per request made by fsutil_aio(). */
+#define AIO_SECTORS 8
+
+/* One of the requests that fsutil_aio() keeps in flight. */
+struct aio_slot
+  {
+    struct block_request r;             /* The request. */
+    struct block_iovec iov;             /* Its buffer. */
+    struct list_elem elem;              /* Element in aio_done. */
+    bool busy;                          /* Submitted, not yet reaped? */
+    int64_t submit_ns;                  /* timer_ns() when submitted. */
+    int64_t latency_ns;                 /* Submission to completion. */
+  };
+
+/* Slots whose requests have completed, and how many.  Since
+   aio_complete() runs with interrupts off, aio_done is protected
+   by disabling interrupts. */
+static struct list aio_done;
+static struct semaphore aio_done_cnt;
+
+/* Completion callback for fsutil_aio()'s requests. */
+static void
+aio_complete (struct block_request *r, void *slot_) 
+{
+  struct aio_slot *slot = slot_;
+
+  ASSERT (r == &slot->r);
+  slot->latency_ns = timer_ns () - slot->submit_ns;
+  list_push_back (&aio_done, &slot->elem);
+  sema_up (&aio_done_cnt);
+}
+
+/* Fills the CNT sectors in BUFFER with the test pattern for the
+   CNT sectors starting at SECTOR: each 32-bit word depends on the
+   sector number and its index within the sector. */
+static void
+pattern_fill (void *buffer, block_sector_t sector, block_sector_t cnt) 
+{
+  uint32_t *words = buffer;
+  size_t i;
+
+  for (i = 0; i < cnt * BLOCK_SECTOR_SIZE / sizeof *words; i++)
+    words[i] = ((sector + i / (BLOCK_SECTOR_SIZE / 4)) * 2654435761u
+                + i % (BLOCK_SECTOR_SIZE / 4));
+}
+
+/* Checks that the CNT sectors in BUFFER hold the test pattern
+   for the CNT sectors starting at SECTOR, as written by
+   pattern_fill().  Panics if not. */
+static void
+pattern_check (const void *buffer, block_sector_t sector, block_sector_t cnt) 
+{
+  const uint32_t *words = buffer;
+  size_t i;
+
+  for (i = 0; i < cnt * BLOCK_SECTOR_SIZE / sizeof *words; i++)
+    {
+      block_sector_t s = sector + i / (BLOCK_SECTOR_SIZE / 4);
+      if (words[i] != s * 2654435761u + i % (BLOCK_SECTOR_SIZE / 4))
+        PANIC ("sector %"PRDSNu" reads back wrong", s);
+    }
+}
+
+/* Waits for a slot that is idle or whose request has completed,
+   and returns it. */
+static struct aio_slot *
+aio_reap (void) 
+{
+  struct aio_slot *slot;
+  enum intr_level old_level;
+
+  sema_down (&aio_done_cnt);
+  old_level = intr_disable ();
+  slot = list_entry (list_pop_front (&aio_done), struct aio_slot, elem);
+  intr_set_level (old_level);
+  return slot;
+}
+
+/* Writes the test pattern to all of DEV, or reads it back and
+   verifies it if WRITE is false, with up to SLOT_CNT requests of
+   AIO_SECTORS sectors in flight, then prints the throughput and
+   the average time from submitting a request to its
+   completion. */
+static void
+aio_pass (struct block *dev, struct aio_slot *slots, size_t slot_cnt,
+          bool write) 
+{
+  block_sector_t size = block_size (dev);
+  block_sector_t sector = 0;
+  size_t in_flight = 0, max_in_flight = 0;
+  unsigned req_cnt = 0;
+  int64_t start, ticks, latency_sum = 0;
+  uint64_t bytes;
+  size_t i;
+
+  list_init (&aio_done);
+  sema_init (&aio_done_cnt, 0);
+  for (i = 0; i < slot_cnt; i++)
+    {
+      slots[i].busy = false;
+      list_push_back (&aio_done, &slots[i].elem);
+      sema_up (&aio_done_cnt);
+    }
+
+  start = timer_ticks ();
+  while (sector < size || in_flight > 0)
+    {
+      struct aio_slot *slot = aio_reap ();
+
+      if (slot->busy)
+        {
+          if (!write)
+            pattern_check (slot->iov.base, slot->r.sector,
+                           slot->iov.len / BLOCK_SECTOR_SIZE);
+          slot->busy = false;
+          latency_sum += slot->latency_ns;
+          in_flight--;
+        }
+
+      if (sector < size)
+        {
+          block_sector_t left = size - sector;
+          block_sector_t cnt = left < AIO_SECTORS ? left : AIO_SECTORS;
+
+          if (write)
+            pattern_fill (slot->iov.base, sector, cnt);
+          slot->iov.len = cnt * BLOCK_SECTOR_SIZE;
+          slot->r.write = write;
+          slot->r.sector = sector;
+          slot->r.iov = &slot->iov;
+          slot->r.iov_cnt = 1;
+          slot->r.complete = aio_complete;
+          slot->r.aux = slot;
+          slot->busy = true;
+          slot->submit_ns = timer_ns ();
+          block_submit (dev, &slot->r);
+
+          sector += cnt;
+          req_cnt++;
+          if (++in_flight > max_in_flight)
+            max_in_flight = in_flight;
+        }
+    }
+  ticks = timer_elapsed (start);
+
+  bytes = (uint64_t) size * BLOCK_SECTOR_SIZE;
+  printf ("%s ", write ? "Wrote" : "Read and verified");
+  print_human_readable_size (bytes);
+  printf (" in %"PRId64" ticks", ticks);
+  if (ticks > 0)
+    printf (" (%"PRIu64" kB/s)", bytes * TIMER_FREQ / ticks / 1024);
+  printf (", %u requests, at most %zu in flight", req_cnt, max_in_flight);
+  if (req_cnt > 0)
+    printf (" (%"PRId64" us/request)", latency_sum / req_cnt / 1000);
+  printf (".\n");
+}
+
+/* Writes a test pattern over the whole scratch device and reads
+   it back, keeping argv[1] requests in flight at once with
+   block_submit(), and panics if the data read differs from that
+   written. */
+void
+fsutil_aio (char **argv) 
+{
+  int depth = atoi (argv[1]);
+  struct aio_slot *slots;
+  struct block *dev;
+  int i;
+
+  if (depth <= 0)
+    PANIC ("%s: requests in flight must be positive", argv[1]);
+
+  dev = block_get_role (BLOCK_SCRATCH);
+  if (dev == NULL)
+    PANIC ("couldn't open scratch device");
+
+  slots = calloc (depth, sizeof *slots);
+  if (slots == NULL)
+    PANIC ("couldn't allocate request slots");
+  for (i = 0; i < depth; i++)
+    {
+      slots[i].iov.base = malloc (AIO_SECTORS * BLOCK_SECTOR_SIZE);
+      if (slots[i].iov.base == NULL)
+        PANIC ("couldn't allocate buffer");
+    }
+
+  printf ("Testing scratch device %s with %d requests in flight...\n",
+          block_name (dev), depth);
+  aio_pass (dev, slots, depth, true);
+  aio_pass (dev, slots, depth, false);
+
+  for (i = 0; i < depth; i++)
+    free (slots[i].iov.base);
+  free (slots);
+}
+
+/* Sectors per transfer made by fsutil_probe(). */
+#define PROBE_SECTORS 8
+
+/* Transfers PROBE_SECTORS sectors of the test pattern to or from
+   DEV around each power of 2 sector number and at the end of
+   the device, writing if WRITE is true, reading and checking if
+   it is false.  Returns the number of transfers. */
+static unsigned
+probe_pass (struct block *dev, void *buffer, bool write) 
+{
+  block_sector_t size = block_size (dev);
+  unsigned probe_cnt = 0;
+  uint64_t p;
+
+  for (p = PROBE_SECTORS; ; p *= 2)
+    {
+      block_sector_t start = (p - PROBE_SECTORS / 2 <= size - PROBE_SECTORS
+                              ? p - PROBE_SECTORS / 2
+                              : size - PROBE_SECTORS);
+      struct block_iovec iov;
+
+      iov.base = buffer;
+      iov.len = PROBE_SECTORS * BLOCK_SECTOR_SIZE;
+      if (write)
+        {
+          pattern_fill (buffer, start, PROBE_SECTORS);
+          block_write_multi (dev, start, &iov, 1);
+        }
+      else
+        {
+          block_read_multi (dev, start, &iov, 1);
+          pattern_check (buffer, start, PROBE_SECTORS);
+        }
+      probe_cnt++;
+
+      if (start == size - PROBE_SECTORS)
+        break;
+    }
+  return probe_cnt;
+}
+
+/* Checks that the scratch device's sector numbers are decoded
+   correctly throughout, e.g. across the 128 GB limit of 28-bit
+   ATA addressing, by writing a test pattern around every power
+   of 2 sector and reading it back.  Panics on a mismatch. */
+void
+fsutil_probe (char **argv UNUSED) 
+{
+  struct block *dev;
+  unsigned probe_cnt;
+  void *buffer;
+
+  dev = block_get_role (BLOCK_SCRATCH);
+  if (dev == NULL)
+    PANIC ("couldn't open scratch device");
+  if (block_size (dev) < PROBE_SECTORS)
+    PANIC ("scratch device too small to probe");
+
+  buffer = malloc (PROBE_SECTORS * BLOCK_SECTOR_SIZE);
+  if (buffer == NULL)
+    PANIC ("couldn't allocate buffer");
+
+  /* Write every probe before reading any back, so that if the
+     driver drops high-order bits of a sector number, one probe
+     overwrites another and the mismatch is caught. */
+  printf ("Probing scratch device %s...\n", block_name (dev));
+  probe_pass (dev, buffer, true);
+  probe_cnt = probe_pass (dev, buffer, false);
+  printf ("Probed %u ranges up to sector %"PRDSNu": all read back "
+          "correctly.\n", probe_cnt, block_size (dev) - 1);
+
+  free (buffer);
+}
+
 /* Copies file FILE_NAME from the file system to the scratch
    device, in ustar format.
 
@@ -2,14 +2,23 @@
 #include <list.h>
 #include <debug.h>
 #include <round.h>
+#include <stdio.h>
 #include <string.h>
 #include "filesys/filesys.h"
 #include "filesys/free-map.h"
+#include "filesys/journal.h"
 #include "threads/malloc.h"
+#include "threads/synch.h"
 
 /* Identifies an inode. */
 #define INODE_MAGIC 0x494e4f44
 
+/* Inode flags. */
+#define INODE_INLINE 0x01               /* Data stored in inode sector. */
+
+/* Largest file whose data is stored inline in its inode sector. */
+#define INODE_INLINE_MAX 499
+
 /* On-disk inode.
    Must be exactly BLOCK_SECTOR_SIZE bytes long. */
 struct inode_disk
@@ -17,7 +26,8 @@ struct inode_disk
     block_sector_t start;               /* First data sector. */
     off_t length;                       /* File size in bytes. */
     unsigned magic;                     /* Magic number. */
-    uint32_t unused[125];               /* Not used. */
+    uint8_t flags;                      /* INODE_* flags. */
+    uint8_t inline_data[INODE_INLINE_MAX]; /* Data, if INODE_INLINE. */
   };
 
 /* Returns the number of sectors to allocate for an inode SIZE
@@ -28,7 +38,19 @@ bytes_to_sectors (off_t size)
   return DIV_ROUND_UP (size, BLOCK_SECTOR_SIZE);
 }
 
-/* In-memory inode. */
+/* Returns true if INODE's data is stored in its inode sector. */
+static inline bool
+is_inline (const struct inode_disk *disk_inode)
+{
+  return (disk_inode->flags & INODE_INLINE) != 0;
+}
+
+/* In-memory inode.
+
+   ELEM and OPEN_CNT are protected by open_inodes_lock.  The
+   remaining fields are protected by RW: readers of the inode's
+   data hold it for reading, and writers, which may change the
+   inode's length and data sectors, hold it for writing. */
 struct inode 
   {
     struct list_elem elem;              /* Element in inode list. */
@@ -37,6 +59,7 @@ struct inode
     bool removed;                       /* True if deleted, false otherwise. */
     int deny_write_cnt;                 /* 0: writes ok, >0: deny writes. */
     struct inode_disk data;             /* Inode content. */
+    struct rwlock rw;                   /* Reader/writer lock. */
   };
 
 /* Returns the block device sector that contains byte offset POS
@@ -47,7 +70,7 @@ static block_sector_t
 byte_to_sector (const struct inode *inode, off_t pos) 
 {
   ASSERT (inode != NULL);
-  if (pos < inode->data.length)
+  if (pos < inode->data.length && !is_inline (&inode->data))
     return inode->data.start + pos / BLOCK_SECTOR_SIZE;
   else
     return -1;
@@ -56,12 +79,20 @@ byte_to_sector (const struct inode *inode, off_t pos)
 /* List of open inodes, so that opening a single inode twice
    returns the same `struct inode'. */
 static struct list open_inodes;
+static struct lock open_inodes_lock;
+
+/* Statistics. */
+static unsigned long long inline_cnt;    /* Files created inline. */
+static unsigned long long block_cnt;     /* Files with data sectors. */
+static unsigned long long sectors_saved; /* Data sectors not needed. */
+static unsigned long long contended_cnt; /* Of closed inodes' locks. */
 
 /* Initializes the inode module. */
 void
 inode_init (void) 
 {
   list_init (&open_inodes);
+  lock_init (&open_inodes_lock);
 }
 
 /* Initializes an inode with LENGTH bytes of data and
@@ -87,17 +118,28 @@ inode_create (block_sector_t sector, off_t length)
       size_t sectors = bytes_to_sectors (length);
       disk_inode->length = length;
       disk_inode->magic = INODE_MAGIC;
-      if (free_map_allocate (sectors, &disk_inode->start)) 
+      if (length <= INODE_INLINE_MAX) 
+        {
+          /* Small enough to live in the inode sector itself, which
+             calloc() has already zeroed. */
+          disk_inode->flags = INODE_INLINE;
+          journal_write (sector, disk_inode);
+          inline_cnt++;
+          sectors_saved += sectors;
+          success = true;
+        }
+      else if (free_map_allocate (sectors, &disk_inode->start)) 
         {
-          block_write (fs_device, sector, disk_inode);
+          journal_write (sector, disk_inode);
           if (sectors > 0) 
             {
               static char zeros[BLOCK_SECTOR_SIZE];
               size_t i;
               
               for (i = 0; i < sectors; i++) 
-                block_write (fs_device, disk_inode->start + i, zeros);
+                journal_write_unlogged (disk_inode->start + i, zeros);
             }
+          block_cnt++;
           success = true; 
         } 
       free (disk_inode);
@@ -105,6 +147,18 @@ inode_create (block_sector_t sector, off_t length)
   return success;
 }
 
+/* Returns the number of sectors that creating or freeing an
+   inode for a file LENGTH bytes long can log: the inode itself
+   and the parts of the free map covering it and its data. */
+size_t
+inode_journal_sectors (off_t length)
+{
+  size_t cnt = 1 + free_map_journal_sectors (1);
+  if (length > INODE_INLINE_MAX)
+    cnt += free_map_journal_sectors (bytes_to_sectors (length));
+  return cnt;
+}
+
 /* Reads an inode from SECTOR
    and returns a `struct inode' that contains it.
    Returns a null pointer if memory allocation fails. */
@@ -114,6 +168,8 @@ inode_open (block_sector_t sector)
   struct list_elem *e;
   struct inode *inode;
 
+  lock_acquire (&open_inodes_lock);
+
   /* Check whether this inode is already open. */
   for (e = list_begin (&open_inodes); e != list_end (&open_inodes);
        e = list_next (e)) 
@@ -121,7 +177,8 @@ inode_open (block_sector_t sector)
       inode = list_entry (e, struct inode, elem);
       if (inode->sector == sector) 
         {
-          inode_reopen (inode);
+          inode->open_cnt++;
+          lock_release (&open_inodes_lock);
           return inode; 
         }
     }
@@ -129,15 +186,22 @@ inode_open (block_sector_t sector)
   /* Allocate memory. */
   inode = malloc (sizeof *inode);
   if (inode == NULL)
-    return NULL;
+    {
+      lock_release (&open_inodes_lock);
+      return NULL;
+    }
 
-  /* Initialize. */
+  /* Initialize.  The inode is read while still holding
+     open_inodes_lock, so that a concurrent opener of the same
+     sector cannot see it half-initialized. */
   list_push_front (&open_inodes, &inode->elem);
   inode->sector = sector;
   inode->open_cnt = 1;
   inode->deny_write_cnt = 0;
   inode->removed = false;
-  block_read (fs_device, inode->sector, &inode->data);
+  rwlock_init (&inode->rw);
+  journal_read (inode->sector, &inode->data);
+  lock_release (&open_inodes_lock);
   return inode;
 }
 
@@ -146,7 +210,11 @@ struct inode *
 inode_reopen (struct inode *inode)
 {
   if (inode != NULL)
-    inode->open_cnt++;
+    {
+      lock_acquire (&open_inodes_lock);
+      inode->open_cnt++;
+      lock_release (&open_inodes_lock);
+    }
   return inode;
 }
 
@@ -168,21 +236,30 @@ inode_close (struct inode *inode)
     return;
 
   /* Release resources if this was the last opener. */
+  lock_acquire (&open_inodes_lock);
   if (--inode->open_cnt == 0)
     {
       /* Remove from inode list and release lock. */
       list_remove (&inode->elem);
+      contended_cnt += inode->rw.contended_cnt;
+      lock_release (&open_inodes_lock);
  
       /* Deallocate blocks if removed. */
       if (inode->removed) 
         {
+          if (!journal_begin (inode_journal_sectors (inode->data.length)))
+            PANIC ("inode %"PRDSNu" too large to free", inode->sector);
           free_map_release (inode->sector, 1);
-          free_map_release (inode->data.start,
-                            bytes_to_sectors (inode->data.length)); 
+          if (!is_inline (&inode->data))
+            free_map_release (inode->data.start,
+                              bytes_to_sectors (inode->data.length)); 
+          journal_end ();
         }
 
       free (inode); 
     }
+  else
+    lock_release (&open_inodes_lock);
 }
 
 /* Marks INODE to be deleted when it is closed by the last caller who
@@ -191,7 +268,9 @@ void
 inode_remove (struct inode *inode) 
 {
   ASSERT (inode != NULL);
+  rwlock_acquire_write (&inode->rw);
   inode->removed = true;
+  rwlock_release_write (&inode->rw);
 }
 
 /* Reads SIZE bytes from INODE into BUFFER, starting at position OFFSET.
@@ -204,6 +283,21 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
   off_t bytes_read = 0;
   uint8_t *bounce = NULL;
 
+  rwlock_acquire_read (&inode->rw);
+  if (is_inline (&inode->data))
+    {
+      /* Copy straight out of the in-memory inode. */
+      if (offset < inode_length (inode))
+        {
+          bytes_read = inode_length (inode) - offset;
+          if (size < bytes_read)
+            bytes_read = size;
+          memcpy (buffer, inode->data.inline_data + offset, bytes_read);
+        }
+      rwlock_release_read (&inode->rw);
+      return bytes_read;
+    }
+
   while (size > 0) 
     {
       /* Disk sector to read, starting byte offset within sector. */
@@ -222,8 +316,13 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
 
       if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE)
         {
-          /* Read full sector directly into caller's buffer. */
-          block_read (fs_device, sector_idx, buffer + bytes_read);
+          /* Read full sectors directly into caller's buffer.  A
+             file's data sectors are contiguous, so read as many
+             as we can with one request. */
+          size_t sector_cnt = (size < inode_left ? size : inode_left)
+                              / BLOCK_SECTOR_SIZE;
+          journal_read_multi (sector_idx, buffer + bytes_read, sector_cnt);
+          chunk_size = sector_cnt * BLOCK_SECTOR_SIZE;
         }
       else 
         {
@@ -235,7 +334,7 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
               if (bounce == NULL)
                 break;
             }
-          block_read (fs_device, sector_idx, bounce);
+          journal_read (sector_idx, bounce);
           memcpy (buffer + bytes_read, bounce + sector_ofs, chunk_size);
         }
       
@@ -244,6 +343,7 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
       offset += chunk_size;
       bytes_read += chunk_size;
     }
+  rwlock_release_read (&inode->rw);
   free (bounce);
 
   return bytes_read;
@@ -262,8 +362,29 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
   off_t bytes_written = 0;
   uint8_t *bounce = NULL;
 
+  /* Writers are exclusive, so that concurrent partial writes to
+     one sector cannot lose each other's updates. */
+  rwlock_acquire_write (&inode->rw);
   if (inode->deny_write_cnt)
-    return 0;
+    {
+      rwlock_release_write (&inode->rw);
+      return 0;
+    }
+
+  if (is_inline (&inode->data))
+    {
+      /* Update the in-memory inode and write back its sector. */
+      if (offset < inode_length (inode))
+        {
+          bytes_written = inode_length (inode) - offset;
+          if (size < bytes_written)
+            bytes_written = size;
+          memcpy (inode->data.inline_data + offset, buffer, bytes_written);
+          journal_write (inode->sector, &inode->data);
+        }
+      rwlock_release_write (&inode->rw);
+      return bytes_written;
+    }
 
   while (size > 0) 
     {
@@ -283,8 +404,13 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
 
       if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE)
         {
-          /* Write full sector directly to disk. */
-          block_write (fs_device, sector_idx, buffer + bytes_written);
+          /* Write full sectors directly to disk, as many as we
+             can with one request. */
+          size_t sector_cnt = (size < inode_left ? size : inode_left)
+                              / BLOCK_SECTOR_SIZE;
+          journal_write_multi (sector_idx, buffer + bytes_written,
+                               sector_cnt);
+          chunk_size = sector_cnt * BLOCK_SECTOR_SIZE;
         }
       else 
         {
@@ -300,11 +426,11 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
              we're writing, then we need to read in the sector
              first.  Otherwise we start with a sector of all zeros. */
           if (sector_ofs > 0 || chunk_size < sector_left) 
-            block_read (fs_device, sector_idx, bounce);
+            journal_read (sector_idx, bounce);
           else
             memset (bounce, 0, BLOCK_SECTOR_SIZE);
           memcpy (bounce + sector_ofs, buffer + bytes_written, chunk_size);
-          block_write (fs_device, sector_idx, bounce);
+          journal_write (sector_idx, bounce);
         }
 
       /* Advance. */
@@ -312,6 +438,7 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
       offset += chunk_size;
       bytes_written += chunk_size;
     }
+  rwlock_release_write (&inode->rw);
   free (bounce);
 
   return bytes_written;
@@ -322,8 +449,10 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
 void
 inode_deny_write (struct inode *inode) 
 {
+  rwlock_acquire_write (&inode->rw);
   inode->deny_write_cnt++;
   ASSERT (inode->deny_write_cnt <= inode->open_cnt);
+  rwlock_release_write (&inode->rw);
 }
 
 /* Re-enables writes to INODE.
@@ -332,14 +461,42 @@ inode_deny_write (struct inode *inode)
 void
 inode_allow_write (struct inode *inode) 
 {
+  rwlock_acquire_write (&inode->rw);
   ASSERT (inode->deny_write_cnt > 0);
   ASSERT (inode->deny_write_cnt <= inode->open_cnt);
   inode->deny_write_cnt--;
+  rwlock_release_write (&inode->rw);
 }
 
-/* Returns the length, in bytes, of INODE's data. */
+/* Returns the length, in bytes, of INODE's data.
+   Reads the length without locking: it is a single aligned word,
+   so a concurrent writer cannot tear it. */
 off_t
 inode_length (const struct inode *inode)
 {
   return inode->data.length;
 }
+
+/* Returns the number of times that acquiring INODE's
+   reader/writer lock had to wait for another thread. */
+unsigned long long
+inode_lock_contention (const struct inode *inode) 
+{
+  return inode->rw.contended_cnt;
+}
+
+/* Prints inode statistics. */
+void
+inode_print_stats (void) 
+{
+  struct list_elem *e;
+  unsigned long long contended = contended_cnt;
+
+  for (e = list_begin (&open_inodes); e != list_end (&open_inodes);
+       e = list_next (e)) 
+    contended += list_entry (e, struct inode, elem)->rw.contended_cnt;
+
+  printf ("Inodes: %llu inline, %llu with data sectors, "
+          "%llu sectors saved, %llu lock contentions\n",
+          inline_cnt, block_cnt, sectors_saved, contended);
+}
@@ -9,6 +9,7 @@ struct bitmap;
 
 void inode_init (void);
 bool inode_create (block_sector_t, off_t);
+size_t inode_journal_sectors (off_t);
 struct inode *inode_open (block_sector_t);
 struct inode *inode_reopen (struct inode *);
 block_sector_t inode_get_inumber (const struct inode *);
@@ -19,5 +20,7 @@ off_t inode_write_at (struct inode *, const void *, off_t size, off_t offset);
 void inode_deny_write (struct inode *);
 void inode_allow_write (struct inode *);
 off_t inode_length (const struct inode *);
+unsigned long long inode_lock_contention (const struct inode *);
+void inode_print_stats (void);
 
 #endif /* filesys/inode.h */
@@ -0,0 +1,785 @@
+#include "filesys/journal.h"
+#include <debug.h>
+#include <hash.h>
+#include <list.h>
+#include <stdio.h>
+#include <string.h>
+#include "filesys/filesys.h"
+#include "filesys/free-map.h"
+#include "devices/shutdown.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+/* Write-ahead journal for file system metadata.
+
+   Operations that update metadata (the free map, inodes, and
+   directories) run inside a transaction bracketed by
+   journal_begin() and journal_end().  While a thread holds a
+   transaction handle, every sector it writes through
+   journal_write() is captured in memory as part of the running
+   transaction instead of being written to its home location.
+
+   Handles from concurrent operations join the same running
+   transaction.  When the first of them ends, the transaction
+   stops admitting new handles, and the last handle to end
+   commits all of them together with one sequential write to the
+   log: a descriptor sector listing the home sectors, the logged
+   sectors themselves, and a commit sector carrying a checksum.
+   Only then are the operations complete.
+
+   Each handle reserves room in the running transaction for the
+   largest number of distinct sectors its operation can log,
+   which the caller works out from what it is about to do.  The
+   free map logs only the sectors of the bitmap that an
+   operation changes, so this stays small however large the file
+   system is.
+
+   Committed sectors stay in memory and reach their home
+   locations lazily, at a checkpoint, which happens when the log
+   fills up or the file system is shut down.  After a crash,
+   journal_open() replays every intact committed transaction
+   still in the log, so that each operation is either entirely
+   present on disk or entirely absent.
+
+   Replay writes logged sectors back to their home locations, so
+   a metadata sector that is freed must not be reused, for
+   example for file data, while an older copy of it is still in
+   the log.  The free map holds such sectors back until the next
+   checkpoint.
+
+   File data is not journaled. */
+
+/* Identifies the journal header, descriptor, and commit sectors. */
+#define JOURNAL_MAGIC 0x4a524e4c
+#define DESC_MAGIC 0x4a444553
+#define COMMIT_MAGIC 0x4a434d54
+
+/* Size of the log, in sectors, allocated at format time. */
+#define JOURNAL_LOG_SECTORS 128
+
+/* Number of home sectors that fit in a descriptor sector. */
+#define DESC_SECTOR_CNT 125
+
+/* On-disk journal header, at JOURNAL_SECTOR.
+   Must be exactly BLOCK_SECTOR_SIZE bytes long. */
+struct journal_header
+  {
+    unsigned magic;                     /* JOURNAL_MAGIC. */
+    block_sector_t log_start;           /* First sector of log. */
+    block_sector_t log_size;            /* Number of sectors in log. */
+    unsigned seq;                       /* Sequence number at log start. */
+    uint32_t unused[124];               /* Not used. */
+  };
+
+/* On-disk descriptor sector that starts a transaction in the log.
+   Must be exactly BLOCK_SECTOR_SIZE bytes long. */
+struct journal_desc
+  {
+    unsigned magic;                     /* DESC_MAGIC. */
+    unsigned seq;                       /* Transaction sequence number. */
+    unsigned cnt;                       /* Number of logged sectors. */
+    block_sector_t sectors[DESC_SECTOR_CNT]; /* Home sectors. */
+  };
+
+/* On-disk commit sector that ends a transaction in the log.
+   Must be exactly BLOCK_SECTOR_SIZE bytes long. */
+struct journal_commit
+  {
+    unsigned magic;                     /* COMMIT_MAGIC. */
+    unsigned seq;                       /* Transaction sequence number. */
+    unsigned cnt;                       /* Number of logged sectors. */
+    unsigned checksum;                  /* Checksum of logged sectors. */
+    uint32_t unused[124];               /* Not used. */
+  };
+
+/* A sector held by the journal, that is, one that belongs to
+   the running transaction or to a committed transaction that
+   has not yet been checkpointed. */
+struct journal_block
+  {
+    struct hash_elem hash_elem;         /* Element in `blocks'. */
+    struct list_elem list_elem;         /* Element in `running'. */
+    block_sector_t sector;              /* Home sector. */
+    bool in_running;                    /* Part of running transaction? */
+    uint8_t data[BLOCK_SECTOR_SIZE];    /* Current contents. */
+  };
+
+/* True once journal_open() has found a valid journal. */
+static bool active;
+
+/* True after a simulated crash, see journal_set_crash(). */
+static bool crashed;
+
+/* Commit number during which to simulate a crash, or 0. */
+static unsigned crash_commit;
+
+/* Log location and the offset of the next free log sector. */
+static block_sector_t log_start;
+static block_sector_t log_size;
+static block_sector_t log_head;
+
+/* Sequence number of the transaction at the start of the log, as
+   recorded in the header. */
+static unsigned log_seq;
+
+/* Protects all the variables below. */
+static struct lock journal_lock;
+
+/* Signaled when a transaction commits. */
+static struct condition journal_cond;
+
+/* All sectors held by the journal, keyed by home sector. */
+static struct hash blocks;
+
+/* Sectors logged by the running transaction, in order. */
+static struct list running;
+static size_t running_cnt;
+
+/* Running transaction state. */
+static unsigned running_seq;    /* Sequence number. */
+static int handle_cnt;          /* Number of open handles. */
+static size_t reserved_cnt;     /* Sectors reserved by handles. */
+static bool closing;            /* No longer admitting new handles? */
+
+/* Sequence number of the most recently committed transaction. */
+static unsigned committed_seq;
+
+/* Statistics. */
+static unsigned long long commit_cnt;     /* Transactions committed. */
+static unsigned long long handle_total;   /* Handles started. */
+static unsigned long long logged_cnt;     /* Sectors written to log. */
+static unsigned long long checkpoint_cnt; /* Checkpoints. */
+static unsigned long long replay_cnt;     /* Transactions replayed. */
+
+static hash_hash_func journal_block_hash;
+static hash_less_func journal_block_less;
+static struct journal_block *find_block (block_sector_t);
+static bool holds_block (block_sector_t, size_t cnt);
+static void free_block (struct hash_elem *, void *aux);
+static size_t transaction_limit (void);
+static void commit (void);
+static void checkpoint (void);
+static unsigned checksum_sector (unsigned, const void *);
+static void write_header (void);
+
+/* Initializes the journal module.  Until journal_open() is
+   called, all writes go straight to the file system device. */
+void
+journal_init (void)
+{
+  lock_init (&journal_lock);
+  cond_init (&journal_cond);
+  hash_init (&blocks, journal_block_hash, journal_block_less, NULL);
+  list_init (&running);
+}
+
+/* Creates an empty journal while formatting the file system.
+   The free map must be open. */
+void
+journal_create (void)
+{
+  struct journal_header *h;
+  static char zeros[BLOCK_SECTOR_SIZE];
+
+  ASSERT (sizeof (struct journal_header) == BLOCK_SECTOR_SIZE);
+  ASSERT (sizeof (struct journal_desc) == BLOCK_SECTOR_SIZE);
+  ASSERT (sizeof (struct journal_commit) == BLOCK_SECTOR_SIZE);
+
+  h = calloc (1, sizeof *h);
+  if (h == NULL)
+    PANIC ("journal creation failed");
+  h->magic = JOURNAL_MAGIC;
+  h->log_size = JOURNAL_LOG_SECTORS;
+  h->seq = 1;
+  if (!free_map_allocate (h->log_size, &h->log_start))
+    PANIC ("not enough space for journal");
+
+  /* Make sure nothing at the start of the log looks like a
+     transaction. */
+  block_write (fs_device, h->log_start, zeros);
+  block_write (fs_device, JOURNAL_SECTOR, h);
+  free (h);
+}
+
+/* Opens the journal and replays any committed transactions left
+   in the log by a crash.  Must be called before anything reads
+   file system metadata, including the free map. */
+void
+journal_open (void)
+{
+  struct journal_header *h;
+  struct journal_desc *d;
+  struct journal_commit *c;
+  void *buffer;
+  block_sector_t pos;
+  unsigned seq;
+
+  h = malloc (sizeof *h);
+  d = malloc (sizeof *d);
+  c = malloc (sizeof *c);
+  buffer = malloc (BLOCK_SECTOR_SIZE);
+  if (h == NULL || d == NULL || c == NULL || buffer == NULL)
+    PANIC ("couldn't allocate journal buffers");
+
+  block_read (fs_device, JOURNAL_SECTOR, h);
+  if (h->magic != JOURNAL_MAGIC || h->log_size < 2
+      || h->log_start + h->log_size > block_size (fs_device))
+    {
+      printf ("journal: no journal found, metadata updates "
+              "are not crash-safe\n");
+      goto done;
+    }
+  log_start = h->log_start;
+  log_size = h->log_size;
+
+  /* Replay each complete transaction, in sequence, until we hit
+     one that is torn, corrupt, or stale. */
+  for (pos = 0, seq = h->seq; pos + 2 <= log_size; seq++)
+    {
+      unsigned checksum = 0;
+      unsigned i;
+
+      block_read (fs_device, log_start + pos, d);
+      if (d->magic != DESC_MAGIC || d->seq != seq || d->cnt == 0
+          || d->cnt > DESC_SECTOR_CNT || pos + d->cnt + 2 > log_size)
+        break;
+      block_read (fs_device, log_start + pos + d->cnt + 1, c);
+      if (c->magic != COMMIT_MAGIC || c->seq != seq || c->cnt != d->cnt)
+        break;
+      for (i = 0; i < d->cnt; i++)
+        {
+          block_read (fs_device, log_start + pos + 1 + i, buffer);
+          checksum = checksum_sector (checksum, buffer);
+        }
+      if (checksum != c->checksum)
+        break;
+
+      for (i = 0; i < d->cnt; i++)
+        {
+          block_read (fs_device, log_start + pos + 1 + i, buffer);
+          block_write (fs_device, d->sectors[i], buffer);
+        }
+      pos += d->cnt + 2;
+      replay_cnt++;
+    }
+  if (replay_cnt > 0)
+    printf ("journal: replayed %llu transaction(s)\n", replay_cnt);
+
+  /* Start over with an empty log. */
+  log_seq = seq;
+  log_head = 0;
+  running_seq = seq;
+  committed_seq = seq - 1;
+  write_header ();
+  active = true;
+
+ done:
+  free (buffer);
+  free (c);
+  free (d);
+  free (h);
+}
+
+/* Commits any running transaction and checkpoints everything
+   the journal holds, leaving the file system consistent on disk
+   without the log. */
+void
+journal_done (void)
+{
+  if (!active || crashed)
+    return;
+
+  lock_acquire (&journal_lock);
+  ASSERT (handle_cnt == 0);
+  if (running_cnt > 0)
+    commit ();
+  checkpoint ();
+  lock_release (&journal_lock);
+}
+
+/* Starts or joins a transaction for the current thread, for an
+   operation that logs at most CNT distinct sectors.  All
+   metadata written through journal_write() until the matching
+   journal_end() becomes part of that transaction.  Handles
+   nest: only the outermost pair has any effect, so its CNT must
+   cover the nested operations too.
+
+   Returns true if successful, false if CNT sectors do not fit
+   in a single transaction, in which case the caller must not
+   call journal_end(). */
+bool
+journal_begin (size_t cnt)
+{
+  struct thread *t = thread_current ();
+
+  if (!active || t->journal_depth > 0)
+    {
+      t->journal_depth++;
+      return true;
+    }
+  if (cnt > transaction_limit ())
+    return false;
+  t->journal_depth++;
+
+  lock_acquire (&journal_lock);
+  for (;;)
+    {
+      size_t needed = reserved_cnt + cnt;
+
+      if (closing)
+        {
+          /* Running transaction is waiting to commit. */
+          cond_wait (&journal_cond, &journal_lock);
+        }
+      else if (needed <= transaction_limit ()
+               && log_head + needed + 2 <= log_size)
+        break;
+      else if (handle_cnt > 0)
+        {
+          /* Running transaction is full.  Let it finish. */
+          closing = true;
+          cond_wait (&journal_cond, &journal_lock);
+        }
+      else if (running_cnt > 0)
+        commit ();
+      else
+        checkpoint ();
+    }
+  handle_cnt++;
+  reserved_cnt += cnt;
+  handle_total++;
+  lock_release (&journal_lock);
+  return true;
+}
+
+/* Ends the current thread's transaction handle.  Returns once
+   the transaction that the handle joined has been committed to
+   the log, committing it if this was its last open handle. */
+void
+journal_end (void)
+{
+  struct thread *t = thread_current ();
+  unsigned seq;
+
+  ASSERT (!active || t->journal_depth > 0);
+  if (!active || --t->journal_depth > 0)
+    return;
+
+  lock_acquire (&journal_lock);
+  seq = running_seq;
+  closing = true;
+  if (--handle_cnt == 0)
+    commit ();
+  else
+    while (committed_seq < seq && !crashed)
+      cond_wait (&journal_cond, &journal_lock);
+  lock_release (&journal_lock);
+}
+
+/* Reads SECTOR from the file system device into BUFFER, which
+   must have room for BLOCK_SECTOR_SIZE bytes, preferring the
+   journal's copy if it holds one that has not yet reached its
+   home location. */
+void
+journal_read (block_sector_t sector, void *buffer)
+{
+  if (active)
+    {
+      struct journal_block *b;
+
+      lock_acquire (&journal_lock);
+      b = find_block (sector);
+      if (b != NULL)
+        {
+          memcpy (buffer, b->data, BLOCK_SECTOR_SIZE);
+          lock_release (&journal_lock);
+          return;
+        }
+      lock_release (&journal_lock);
+    }
+  block_read (fs_device, sector, buffer);
+}
+
+/* Writes BUFFER to SECTOR on the file system device.  If the
+   current thread holds a transaction handle, the sector is
+   logged as part of its transaction; otherwise this is the same
+   as journal_write_unlogged(). */
+void
+journal_write (block_sector_t sector, const void *buffer)
+{
+  struct journal_block *b;
+
+  if (!active || thread_current ()->journal_depth == 0)
+    {
+      journal_write_unlogged (sector, buffer);
+      return;
+    }
+
+  lock_acquire (&journal_lock);
+  b = find_block (sector);
+  if (b == NULL)
+    {
+      b = malloc (sizeof *b);
+      if (b == NULL)
+        PANIC ("couldn't allocate journal block");
+      b->sector = sector;
+      b->in_running = false;
+      hash_insert (&blocks, &b->hash_elem);
+    }
+  if (!b->in_running)
+    {
+      if (running_cnt >= reserved_cnt)
+        PANIC ("transaction overflowed its reservation");
+      b->in_running = true;
+      list_push_back (&running, &b->list_elem);
+      running_cnt++;
+    }
+  memcpy (b->data, buffer, BLOCK_SECTOR_SIZE);
+  lock_release (&journal_lock);
+}
+
+/* Writes BUFFER to SECTOR on the file system device without
+   logging it, even if the current thread holds a transaction
+   handle.  Used for file data and for zeroing newly allocated
+   sectors.
+
+   If the journal still holds an older copy of SECTOR, for
+   example because it was a directory sector that has since been
+   freed and reused, that copy is updated instead, so that a
+   later checkpoint does not overwrite the new contents. */
+void
+journal_write_unlogged (block_sector_t sector, const void *buffer)
+{
+  if (active)
+    {
+      struct journal_block *b;
+
+      lock_acquire (&journal_lock);
+      b = find_block (sector);
+      if (b != NULL)
+        {
+          memcpy (b->data, buffer, BLOCK_SECTOR_SIZE);
+          lock_release (&journal_lock);
+          return;
+        }
+      lock_release (&journal_lock);
+    }
+  block_write (fs_device, sector, buffer);
+}
+
+/* Reads the CNT consecutive sectors starting at SECTOR from the
+   file system device into BUFFER, which must have room for CNT
+   * BLOCK_SECTOR_SIZE bytes.  Like journal_read(), but uses a
+   single multi-sector request unless the journal holds a copy of
+   one of the sectors. */
+void
+journal_read_multi (block_sector_t sector, void *buffer_, size_t cnt)
+{
+  uint8_t *buffer = buffer_;
+  struct block_iovec iov;
+  size_t i;
+
+  iov.base = buffer;
+  iov.len = cnt * BLOCK_SECTOR_SIZE;
+  if (!active)
+    {
+      block_read_multi (fs_device, sector, &iov, 1);
+      return;
+    }
+
+  /* As in journal_read(), decide under the lock and do the I/O
+     without it.  The caller's inode lock keeps out handles that
+     would log these sectors, and freed sectors are not reused
+     until a checkpoint, so the journal cannot start holding one
+     of them in the meantime. */
+  if (!journal_holds (sector, cnt))
+    block_read_multi (fs_device, sector, &iov, 1);
+  else
+    for (i = 0; i < cnt; i++)
+      journal_read (sector + i, buffer + i * BLOCK_SECTOR_SIZE);
+}
+
+/* Writes CNT sectors from BUFFER to the consecutive sectors
+   starting at SECTOR on the file system device.  Like
+   journal_write(), but uses a single multi-sector request when
+   the writes are not logged and the journal holds a copy of none
+   of the sectors. */
+void
+journal_write_multi (block_sector_t sector, const void *buffer_, size_t cnt)
+{
+  const uint8_t *buffer = buffer_;
+  struct block_iovec iov;
+  size_t i;
+
+  if (active && thread_current ()->journal_depth > 0)
+    {
+      for (i = 0; i < cnt; i++)
+        journal_write (sector + i, buffer + i * BLOCK_SECTOR_SIZE);
+      return;
+    }
+
+  iov.base = (void *) buffer;
+  iov.len = cnt * BLOCK_SECTOR_SIZE;
+  if (!active)
+    {
+      block_write_multi (fs_device, sector, &iov, 1);
+      return;
+    }
+
+  /* Decided under the lock, done without it, for the reasons
+     given in journal_read_multi(). */
+  if (!journal_holds (sector, cnt))
+    block_write_multi (fs_device, sector, &iov, 1);
+  else
+    for (i = 0; i < cnt; i++)
+      journal_write_unlogged (sector + i, buffer + i * BLOCK_SECTOR_SIZE);
+}
+
+/* Returns true if the journal holds a copy of any of the CNT
+   sectors starting at SECTOR. */
+bool
+journal_holds (block_sector_t sector, size_t cnt)
+{
+  bool found;
+
+  if (!active)
+    return false;
+
+  lock_acquire (&journal_lock);
+  found = holds_block (sector, cnt);
+  lock_release (&journal_lock);
+  return found;
+}
+
+/* Arranges for the kernel to power off partway through writing
+   commit number COMMIT_NO to the log, as if it had crashed, for
+   testing recovery.  Controlled by kernel command-line option
+   "-jcrash". */
+void
+journal_set_crash (unsigned commit_no)
+{
+  crash_commit = commit_no;
+}
+
+/* Prints journal statistics. */
+void
+journal_print_stats (void)
+{
+  if (!active)
+    return;
+  printf ("Journal: %llu transactions, %llu handles, %llu sectors logged, "
+          "%llu checkpoints, %llu replayed\n",
+          commit_cnt, handle_total, logged_cnt, checkpoint_cnt, replay_cnt);
+}
+
+/* Returns the hash value for journal block E. */
+static unsigned
+journal_block_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  const struct journal_block *b
+    = hash_entry (e, struct journal_block, hash_elem);
+  return hash_int (b->sector);
+}
+
+/* Returns true if journal block A precedes journal block B. */
+static bool
+journal_block_less (const struct hash_elem *a_, const struct hash_elem *b_,
+                    void *aux UNUSED)
+{
+  const struct journal_block *a
+    = hash_entry (a_, struct journal_block, hash_elem);
+  const struct journal_block *b
+    = hash_entry (b_, struct journal_block, hash_elem);
+  return a->sector < b->sector;
+}
+
+/* Returns the journal block for SECTOR, or a null pointer if the
+   journal does not hold SECTOR.  The journal lock must be
+   held. */
+static struct journal_block *
+find_block (block_sector_t sector)
+{
+  struct journal_block key;
+  struct hash_elem *e;
+
+  key.sector = sector;
+  e = hash_find (&blocks, &key.hash_elem);
+  return e != NULL ? hash_entry (e, struct journal_block, hash_elem) : NULL;
+}
+
+/* Returns true if the journal holds a copy of any of the CNT
+   sectors starting at SECTOR.  The journal lock must be held. */
+static bool
+holds_block (block_sector_t sector, size_t cnt)
+{
+  size_t i;
+
+  if (!hash_empty (&blocks))
+    for (i = 0; i < cnt; i++)
+      if (find_block (sector + i) != NULL)
+        return true;
+  return false;
+}
+
+/* Returns the maximum number of sectors in a single
+   transaction. */
+static size_t
+transaction_limit (void)
+{
+  return log_size - 2 < DESC_SECTOR_CNT ? log_size - 2 : DESC_SECTOR_CNT;
+}
+
+/* Writes the running transaction to the log as a single
+   sequential run of sectors and wakes up the threads waiting for
+   it.  The journal lock must be held and no handles may be
+   open. */
+static void
+commit (void)
+{
+  struct journal_desc *d;
+  struct journal_commit *c;
+  struct block_iovec *iov;
+  struct list_elem *e;
+  block_sector_t pos;
+  unsigned checksum = 0;
+  unsigned i;
+
+  ASSERT (lock_held_by_current_thread (&journal_lock));
+  ASSERT (handle_cnt == 0);
+  ASSERT (log_head + running_cnt + 2 <= log_size);
+
+  if (running_cnt > 0)
+    {
+      d = calloc (1, sizeof *d);
+      c = calloc (1, sizeof *c);
+      if (d == NULL || c == NULL)
+        PANIC ("couldn't allocate commit buffers");
+
+      d->magic = DESC_MAGIC;
+      d->seq = running_seq;
+      d->cnt = running_cnt;
+      i = 0;
+      for (e = list_begin (&running); e != list_end (&running);
+           e = list_next (e))
+        d->sectors[i++] = list_entry (e, struct journal_block,
+                                      list_elem)->sector;
+
+      /* Gather the logged sectors, which follow the descriptor
+         in the log, into a single request. */
+      iov = malloc ((running_cnt + 1) * sizeof *iov);
+      if (iov == NULL)
+        PANIC ("couldn't allocate commit buffers");
+      iov[0].base = d;
+      iov[0].len = BLOCK_SECTOR_SIZE;
+      i = 1;
+      for (e = list_begin (&running); e != list_end (&running);
+           e = list_next (e))
+        {
+          struct journal_block *b = list_entry (e, struct journal_block,
+                                                list_elem);
+          iov[i].base = b->data;
+          iov[i++].len = BLOCK_SECTOR_SIZE;
+          checksum = checksum_sector (checksum, b->data);
+        }
+
+      pos = log_start + log_head;
+      commit_cnt++;
+      if (crash_commit == commit_cnt)
+        {
+          block_write_multi (fs_device, pos, iov, 1 + running_cnt / 2);
+          printf ("journal: simulating crash during commit %llu\n",
+                  commit_cnt);
+          crashed = true;
+          shutdown_power_off ();
+        }
+      block_write_multi (fs_device, pos, iov, running_cnt + 1);
+      pos += running_cnt + 1;
+      free (iov);
+
+      c->magic = COMMIT_MAGIC;
+      c->seq = running_seq;
+      c->cnt = running_cnt;
+      c->checksum = checksum;
+      block_write (fs_device, pos, c);
+      logged_cnt += running_cnt + 2;
+      log_head += running_cnt + 2;
+      free (c);
+      free (d);
+
+      while (!list_empty (&running))
+        {
+          struct journal_block *b = list_entry (list_pop_front (&running),
+                                                struct journal_block,
+                                                list_elem);
+          b->in_running = false;
+        }
+    }
+
+  committed_seq = running_seq++;
+  running_cnt = 0;
+  reserved_cnt = 0;
+  closing = false;
+  cond_broadcast (&journal_cond, &journal_lock);
+}
+
+/* Writes every committed sector to its home location and empties
+   the log.  The journal lock must be held and there must be no
+   running transaction. */
+static void
+checkpoint (void)
+{
+  struct hash_iterator i;
+
+  ASSERT (lock_held_by_current_thread (&journal_lock));
+  ASSERT (running_cnt == 0);
+
+  hash_first (&i, &blocks);
+  while (hash_next (&i))
+    {
+      struct journal_block *b = hash_entry (hash_cur (&i),
+                                            struct journal_block, hash_elem);
+      block_write (fs_device, b->sector, b->data);
+    }
+  hash_clear (&blocks, free_block);
+
+  /* Only once the home locations are up to date is it safe to
+     forget the log, and with it any reason not to reuse freed
+     sectors. */
+  log_seq = running_seq;
+  log_head = 0;
+  write_header ();
+  free_map_checkpoint ();
+  checkpoint_cnt++;
+}
+
+/* Frees journal block E.  Helper for hash_clear(). */
+static void
+free_block (struct hash_elem *e, void *aux UNUSED)
+{
+  free (hash_entry (e, struct journal_block, hash_elem));
+}
+
+/* Folds the BLOCK_SECTOR_SIZE bytes in SECTOR into CHECKSUM and
+   returns the result. */
+static unsigned
+checksum_sector (unsigned checksum, const void *sector)
+{
+  return checksum * 31 + hash_bytes (sector, BLOCK_SECTOR_SIZE);
+}
+
+/* Writes the journal header, recording the current log position
+   and the sequence number expected at the start of the log. */
+static void
+write_header (void)
+{
+  struct journal_header *h = calloc (1, sizeof *h);
+  if (h == NULL)
+    PANIC ("couldn't allocate journal header");
+  h->magic = JOURNAL_MAGIC;
+  h->log_start = log_start;
+  h->log_size = log_size;
+  h->seq = log_seq;
+  block_write (fs_device, JOURNAL_SECTOR, h);
+  free (h);
+}
@@ -0,0 +1,27 @@
+#ifndef FILESYS_JOURNAL_H
+#define FILESYS_JOURNAL_H
+
+#include <stdbool.h>
+#include "devices/block.h"
+
+void journal_init (void);
+void journal_create (void);
+void journal_open (void);
+void journal_done (void);
+
+/* Transactions. */
+bool journal_begin (size_t cnt);
+void journal_end (void);
+
+/* File system device access. */
+void journal_read (block_sector_t, void *);
+void journal_write (block_sector_t, const void *);
+void journal_write_unlogged (block_sector_t, const void *);
+void journal_read_multi (block_sector_t, void *, size_t cnt);
+void journal_write_multi (block_sector_t, const void *, size_t cnt);
+bool journal_holds (block_sector_t, size_t cnt);
+
+void journal_set_crash (unsigned commit_no);
+void journal_print_stats (void);
+
+#endif /* filesys/journal.h */
@@ -1,6 +1,7 @@
 #include <console.h>
 #include <stdarg.h>
 #include <stdio.h>
+#include <string.h>
 #include "devices/serial.h"
 #include "devices/vga.h"
 #include "threads/init.h"
@@ -8,7 +9,19 @@
 #include "threads/synch.h"
 
 static void vprintf_helper (char, void *);
-static void putchar_have_lock (uint8_t c);
+static void putbuf_have_lock (const char *, size_t);
+
+/* vprintf() gathers its output in a buffer of this many bytes
+   and writes it to the console a buffer at a time. */
+#define VPRINTF_BUF_SIZE 128
+
+/* Output buffer for vprintf(). */
+struct vprintf_buf
+  {
+    char buf[VPRINTF_BUF_SIZE]; /* Output not yet written. */
+    size_t len;                 /* Number of bytes in BUF. */
+    int char_cnt;               /* Number of characters output. */
+  };
 
 /* The console lock.
    Both the vga and serial layers do their own locking, so it's
@@ -81,6 +94,7 @@ void
 console_print_stats (void) 
 {
   printf ("Console: %lld characters output\n", write_cnt);
+  serial_print_stats ();
 }
 
 /* Acquires the console lock. */
@@ -125,13 +139,16 @@ console_locked_by_current_thread (void)
 int
 vprintf (const char *format, va_list args) 
 {
-  int char_cnt = 0;
+  struct vprintf_buf b;
 
+  b.len = 0;
+  b.char_cnt = 0;
   acquire_console ();
-  __vprintf (format, args, vprintf_helper, &char_cnt);
+  __vprintf (format, args, vprintf_helper, &b);
+  putbuf_have_lock (b.buf, b.len);
   release_console ();
 
-  return char_cnt;
+  return b.char_cnt;
 }
 
 /* Writes string S to the console, followed by a new-line
@@ -140,9 +157,8 @@ int
 puts (const char *s) 
 {
   acquire_console ();
-  while (*s != '\0')
-    putchar_have_lock (*s++);
-  putchar_have_lock ('\n');
+  putbuf_have_lock (s, strlen (s));
+  putbuf_have_lock ("\n", 1);
   release_console ();
 
   return 0;
@@ -153,8 +169,7 @@ void
 putbuf (const char *buffer, size_t n) 
 {
   acquire_console ();
-  while (n-- > 0)
-    putchar_have_lock (*buffer++);
+  putbuf_have_lock (buffer, n);
   release_console ();
 }
 
@@ -162,30 +177,41 @@ putbuf (const char *buffer, size_t n)
 int
 putchar (int c) 
 {
+  char ch = c;
+
   acquire_console ();
-  putchar_have_lock (c);
+  putbuf_have_lock (&ch, 1);
   release_console ();
   
   return c;
 }
-
+
 /* Helper function for vprintf(). */
 static void
-vprintf_helper (char c, void *char_cnt_) 
+vprintf_helper (char c, void *b_) 
 {
-  int *char_cnt = char_cnt_;
-  (*char_cnt)++;
-  putchar_have_lock (c);
+  struct vprintf_buf *b = b_;
+
+  b->char_cnt++;
+  b->buf[b->len++] = c;
+  if (b->len >= sizeof b->buf)
+    {
+      putbuf_have_lock (b->buf, b->len);
+      b->len = 0;
+    }
 }
 
-/* Writes C to the vga display and serial port.
+/* Writes the N characters in BUFFER to the vga display and
+   serial port, handing each the whole buffer at once.
    The caller has already acquired the console lock if
    appropriate. */
 static void
-putchar_have_lock (uint8_t c) 
+putbuf_have_lock (const char *buffer, size_t n) 
 {
   ASSERT (console_locked_by_current_thread ());
-  write_cnt++;
-  serial_putc (c);
-  vga_putc (c);
+  if (n == 0)
+    return;
+  write_cnt += n;
+  serial_putbuf (buffer, n);
+  vga_putbuf (buffer, n);
 }
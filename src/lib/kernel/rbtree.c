@@ -0,0 +1,366 @@
+#include "rbtree.h"
+#include "../debug.h"
+
+/* Red-black tree, following the algorithms in chapter 13 of
+   Cormen, Leiserson, Rivest, and Stein, _Introduction to
+   Algorithms_, with null pointers in place of the sentinel.
+
+   Invariants:
+
+     1. Every element is red or black.  The root is black.
+
+     2. A red element has no red children.
+
+     3. Every path from an element down to a null child passes
+        through the same number of black elements.
+
+   Together these keep the height of a tree of N elements under
+   2 lg (N + 1). */
+
+static void rotate_left (struct rb_tree *, struct rb_elem *);
+static void rotate_right (struct rb_tree *, struct rb_elem *);
+static void replace_child (struct rb_tree *, struct rb_elem *old,
+                           struct rb_elem *new);
+static void insert_fixup (struct rb_tree *, struct rb_elem *);
+static void remove_fixup (struct rb_tree *, struct rb_elem *,
+                          struct rb_elem *parent);
+static struct rb_elem *leftmost (struct rb_elem *);
+
+static inline bool
+is_red (const struct rb_elem *e) 
+{
+  return e != NULL && e->red;
+}
+
+/* Initializes TREE as an empty tree ordered by LESS given
+   auxiliary data AUX. */
+void
+rb_init (struct rb_tree *tree, rb_less_func *less, void *aux) 
+{
+  ASSERT (tree != NULL);
+  ASSERT (less != NULL);
+
+  tree->root = NULL;
+  tree->min = NULL;
+  tree->size = 0;
+  tree->less = less;
+  tree->aux = aux;
+}
+
+/* Inserts ELEM into TREE.  ELEM is placed after any elements
+   equal to it, so equal elements come out of rb_min() in the
+   order they were inserted. */
+void
+rb_insert (struct rb_tree *tree, struct rb_elem *elem) 
+{
+  struct rb_elem *parent = NULL;
+  struct rb_elem **link = &tree->root;
+  bool is_min = true;
+
+  ASSERT (tree != NULL);
+  ASSERT (elem != NULL);
+
+  while (*link != NULL) 
+    {
+      parent = *link;
+      if (tree->less (elem, parent, tree->aux))
+        link = &parent->left;
+      else
+        {
+          link = &parent->right;
+          is_min = false;
+        }
+    }
+
+  elem->parent = parent;
+  elem->left = elem->right = NULL;
+  elem->red = true;
+  *link = elem;
+  if (is_min)
+    tree->min = elem;
+  tree->size++;
+
+  insert_fixup (tree, elem);
+}
+
+/* Removes ELEM, which must be in TREE, from TREE. */
+void
+rb_remove (struct rb_tree *tree, struct rb_elem *elem) 
+{
+  struct rb_elem *child, *parent;
+  bool removed_red;
+
+  ASSERT (tree != NULL);
+  ASSERT (elem != NULL);
+  ASSERT (tree->size > 0);
+
+  if (tree->min == elem)
+    tree->min = rb_next (elem);
+
+  if (elem->left == NULL || elem->right == NULL) 
+    {
+      /* ELEM has at most one child, which takes its place. */
+      child = elem->left != NULL ? elem->left : elem->right;
+      parent = elem->parent;
+      removed_red = elem->red;
+      if (child != NULL)
+        child->parent = parent;
+      replace_child (tree, elem, child);
+    }
+  else
+    {
+      /* ELEM's successor, which has no left child, takes its
+         place, and the successor's right child takes the
+         successor's. */
+      struct rb_elem *next = leftmost (elem->right);
+
+      child = next->right;
+      removed_red = next->red;
+      if (next->parent == elem)
+        parent = next;
+      else
+        {
+          parent = next->parent;
+          if (child != NULL)
+            child->parent = parent;
+          parent->left = child;
+          next->right = elem->right;
+          next->right->parent = next;
+        }
+      next->left = elem->left;
+      next->left->parent = next;
+      next->parent = elem->parent;
+      next->red = elem->red;
+      replace_child (tree, elem, next);
+    }
+  tree->size--;
+
+  if (!removed_red)
+    remove_fixup (tree, child, parent);
+}
+
+/* Returns the least element in TREE, or a null pointer if TREE is
+   empty. */
+struct rb_elem *
+rb_min (const struct rb_tree *tree) 
+{
+  ASSERT (tree != NULL);
+  return tree->min;
+}
+
+/* Returns the element after ELEM in its tree, or a null pointer
+   if ELEM is the greatest element. */
+struct rb_elem *
+rb_next (const struct rb_elem *elem) 
+{
+  ASSERT (elem != NULL);
+
+  if (elem->right != NULL)
+    return leftmost (elem->right);
+  while (elem->parent != NULL && elem == elem->parent->right)
+    elem = elem->parent;
+  return elem->parent;
+}
+
+/* Returns the number of elements in TREE. */
+size_t
+rb_size (const struct rb_tree *tree) 
+{
+  ASSERT (tree != NULL);
+  return tree->size;
+}
+
+/* Returns true if TREE is empty, false otherwise. */
+bool
+rb_empty (const struct rb_tree *tree) 
+{
+  ASSERT (tree != NULL);
+  return tree->root == NULL;
+}
+
+/* Restores the invariants after inserting red element E. */
+static void
+insert_fixup (struct rb_tree *tree, struct rb_elem *e) 
+{
+  while (is_red (e->parent)) 
+    {
+      /* E's parent is red, so it is not the root and E has a
+         grandparent. */
+      struct rb_elem *parent = e->parent;
+      struct rb_elem *grandparent = parent->parent;
+
+      if (parent == grandparent->left) 
+        {
+          struct rb_elem *uncle = grandparent->right;
+          if (is_red (uncle)) 
+            {
+              parent->red = uncle->red = false;
+              grandparent->red = true;
+              e = grandparent;
+              continue;
+            }
+          if (e == parent->right) 
+            {
+              rotate_left (tree, parent);
+              e = parent;
+              parent = e->parent;
+            }
+          parent->red = false;
+          grandparent->red = true;
+          rotate_right (tree, grandparent);
+        }
+      else
+        {
+          struct rb_elem *uncle = grandparent->left;
+          if (is_red (uncle)) 
+            {
+              parent->red = uncle->red = false;
+              grandparent->red = true;
+              e = grandparent;
+              continue;
+            }
+          if (e == parent->left) 
+            {
+              rotate_right (tree, parent);
+              e = parent;
+              parent = e->parent;
+            }
+          parent->red = false;
+          grandparent->red = true;
+          rotate_left (tree, grandparent);
+        }
+    }
+  tree->root->red = false;
+}
+
+/* Restores the invariants after removing a black element whose
+   place was taken by E, which may be null, a child of PARENT.
+   E carries an extra black that must be pushed up the tree or
+   absorbed. */
+static void
+remove_fixup (struct rb_tree *tree, struct rb_elem *e,
+              struct rb_elem *parent) 
+{
+  while (e != tree->root && !is_red (e)) 
+    {
+      if (e == parent->left) 
+        {
+          struct rb_elem *sibling = parent->right;
+          if (is_red (sibling)) 
+            {
+              sibling->red = false;
+              parent->red = true;
+              rotate_left (tree, parent);
+              sibling = parent->right;
+            }
+          if (!is_red (sibling->left) && !is_red (sibling->right)) 
+            {
+              sibling->red = true;
+              e = parent;
+              parent = e->parent;
+              continue;
+            }
+          if (!is_red (sibling->right)) 
+            {
+              sibling->left->red = false;
+              sibling->red = true;
+              rotate_right (tree, sibling);
+              sibling = parent->right;
+            }
+          sibling->red = parent->red;
+          parent->red = false;
+          sibling->right->red = false;
+          rotate_left (tree, parent);
+        }
+      else
+        {
+          struct rb_elem *sibling = parent->left;
+          if (is_red (sibling)) 
+            {
+              sibling->red = false;
+              parent->red = true;
+              rotate_right (tree, parent);
+              sibling = parent->left;
+            }
+          if (!is_red (sibling->left) && !is_red (sibling->right)) 
+            {
+              sibling->red = true;
+              e = parent;
+              parent = e->parent;
+              continue;
+            }
+          if (!is_red (sibling->left)) 
+            {
+              sibling->right->red = false;
+              sibling->red = true;
+              rotate_left (tree, sibling);
+              sibling = parent->left;
+            }
+          sibling->red = parent->red;
+          parent->red = false;
+          sibling->left->red = false;
+          rotate_right (tree, parent);
+        }
+      e = tree->root;
+    }
+  if (e != NULL)
+    e->red = false;
+}
+
+/* Makes E's right child take E's place, with E as its left
+   child. */
+static void
+rotate_left (struct rb_tree *tree, struct rb_elem *e) 
+{
+  struct rb_elem *r = e->right;
+
+  e->right = r->left;
+  if (r->left != NULL)
+    r->left->parent = e;
+  r->parent = e->parent;
+  replace_child (tree, e, r);
+  r->left = e;
+  e->parent = r;
+}
+
+/* Makes E's left child take E's place, with E as its right
+   child. */
+static void
+rotate_right (struct rb_tree *tree, struct rb_elem *e) 
+{
+  struct rb_elem *l = e->left;
+
+  e->left = l->right;
+  if (l->right != NULL)
+    l->right->parent = e;
+  l->parent = e->parent;
+  replace_child (tree, e, l);
+  l->right = e;
+  e->parent = l;
+}
+
+/* Points the link to OLD from OLD's parent, or the root if OLD
+   has no parent, to NEW instead.  Does not update NEW's parent
+   pointer. */
+static void
+replace_child (struct rb_tree *tree, struct rb_elem *old,
+               struct rb_elem *new) 
+{
+  struct rb_elem *parent = old->parent;
+
+  if (parent == NULL)
+    tree->root = new;
+  else if (parent->left == old)
+    parent->left = new;
+  else
+    parent->right = new;
+}
+
+/* Returns the least element in the subtree rooted at E. */
+static struct rb_elem *
+leftmost (struct rb_elem *e) 
+{
+  while (e->left != NULL)
+    e = e->left;
+  return e;
+}
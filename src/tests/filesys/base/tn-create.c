@@ -0,0 +1,5 @@
+/* Tests that create properly zeros out the contents of a file
+   small enough to be stored inside its inode. */
+
+#define TEST_SIZE 123
+#include "tests/filesys/create.inc"
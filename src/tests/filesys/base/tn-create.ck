@@ -0,0 +1,13 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(tn-create) begin
+(tn-create) create "blargle"
+(tn-create) open "blargle" for verification
+(tn-create) verified contents of "blargle"
+(tn-create) close "blargle"
+(tn-create) end
+EOF
+pass;
@@ -0,0 +1,6 @@
+/* Writes out the contents of a file small enough to be stored
+   inside its inode all at once, and then reads it back to make
+   sure that it was written properly. */
+
+#define TEST_SIZE 345
+#include "tests/filesys/base/full.inc"
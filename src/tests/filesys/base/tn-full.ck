@@ -0,0 +1,16 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(tn-full) begin
+(tn-full) create "quux"
+(tn-full) open "quux"
+(tn-full) writing "quux"
+(tn-full) close "quux"
+(tn-full) open "quux" for verification
+(tn-full) verified contents of "quux"
+(tn-full) close "quux"
+(tn-full) end
+EOF
+pass;
@@ -0,0 +1,28 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+
+# Checks the output of the "aio 32" action on a 1 MB scratch
+# partition, which takes 256 requests of 8 sectors each way.
+# fsutil_aio() panics if any sector reads back wrong, which
+# common_checks() catches.  Returns the output.
+sub check_aio {
+    our ($test);
+    my (@output) = read_text_file ("$test.output");
+    common_checks ("run", @output);
+
+    foreach my $verb ("Wrote", "Read and verified") {
+	my ($line) = grep (/^$verb /, @output);
+	fail "no \"$verb\" line in output\n" if !defined $line;
+	my ($reqs, $in_flight)
+	  = $line =~ /, (\d+) requests, at most (\d+) in flight \(\d+ us\/request\)\.$/
+	  or fail "can't parse \"$line\"\n";
+	fail "$verb: expected 256 requests, got $reqs\n" if $reqs != 256;
+	fail "$verb: expected 32 requests in flight, got $in_flight\n"
+	  if $in_flight != 32;
+    }
+    return @output;
+}
+
+1;
@@ -0,0 +1,11 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+use tests::filesys::block::aio;
+my (@output) = check_aio ();
+
+# Make sure the scratch partition really was on a virtio disk.
+fail "scratch device is not on a virtio disk\n"
+  if !grep (/^Testing scratch device vd[a-z]\d* /, @output);
+pass;
@@ -0,0 +1,18 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+our ($test);
+my (@output) = read_text_file ("$test.output");
+common_checks ("run", @output);
+
+# fsutil_probe() panics if any probe reads back wrong, which
+# common_checks() catches.  The probes must reach past the
+# 2**28 sectors that 28-bit LBA can address.
+my ($line) = grep (/^Probed /, @output);
+fail "no \"Probed\" line in output\n" if !defined $line;
+my ($last) = $line =~ /up to sector (\d+): all read back correctly\.$/
+  or fail "can't parse \"$line\"\n";
+fail "probes ended at sector $last, within reach of 28-bit LBA\n"
+  if $last < 2**28;
+pass;
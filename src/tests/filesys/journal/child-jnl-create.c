@@ -0,0 +1,35 @@
+/* Child process for the jnl-create tests.
+   Repeatedly creates and removes a file whose name is unique to
+   this child, so that each iteration is two journal
+   transactions. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <syscall.h>
+#include "tests/lib.h"
+
+const char *test_name = "child-jnl-create";
+
+int
+main (int argc, const char *argv[]) 
+{
+  char file_name[16];
+  int child_idx;
+  int create_cnt;
+  int i;
+
+  quiet = true;
+
+  CHECK (argc == 3, "argc must be 3, actually %d", argc);
+  child_idx = atoi (argv[1]);
+  create_cnt = atoi (argv[2]);
+
+  snprintf (file_name, sizeof file_name, "jnl%d", child_idx);
+  for (i = 0; i < create_cnt; i++) 
+    {
+      CHECK (create (file_name, 0), "create \"%s\"", file_name);
+      CHECK (remove (file_name), "remove \"%s\"", file_name);
+    }
+
+  return child_idx;
+}
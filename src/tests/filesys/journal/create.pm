@@ -0,0 +1,38 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+
+# Checks the output of jnl-create-$CHILDREN, which creates and
+# removes 64 files split among $CHILDREN processes, and reports
+# creates per second.  The test prints how many TSC cycles the
+# creates took, and the kernel prints how many cycles make a
+# second when it calibrates its timer.
+sub check_jnl_create {
+    my ($children) = @_;
+    our ($test);
+    my ($name) = "jnl-create-$children";
+    my ($per_child) = 64 / $children;
+
+    my ($expected) = "($name) begin\n";
+    $expected .= "($name) exec child $_ of $children: "
+      . "\"child-jnl-create " . ($_ - 1) . " $per_child\"\n"
+	foreach 1...$children;
+    $expected .= "($name) wait for child $_ of $children returned "
+      . ($_ - 1) . " (expected " . ($_ - 1) . ")\n"
+	foreach 1...$children;
+    $expected .= "($name) 64 creates in # cycles\n";
+    $expected .= "($name) end\n";
+    check_expected (IGNORE_EXIT_CODES => 1, IGNORE_NUMBERS => 1,
+		    [$expected]);
+
+    my (@output) = read_text_file ("$test.output");
+    my ($hz) = map (/^Calibrating timer\.\.\.\s+([\d,]+) cycles\/s\.$/,
+		    @output);
+    my ($cycles) = map (/^\($name\) 64 creates in (\d+) cycles$/, @output);
+    pass if !defined $hz || !$cycles;
+    $hz =~ tr/,//d;
+    pass sprintf ("%.0f creates/s", 64 * $hz / $cycles);
+}
+
+1;
@@ -0,0 +1,31 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+our ($test);
+my (@output) = read_text_file ("$test.output");
+common_checks ("file system check", @output);
+
+fail "journal was not replayed after the crash\n"
+  if !grep (/^journal: replayed \d+ transaction\(s\)$/, @output);
+
+# Collect the names listed by the "ls" action.
+my (%files);
+my ($in_listing) = 0;
+for (@output) {
+    $in_listing = 1, next if /^Files in the root directory:$/;
+    last if /^End of listing\.$/;
+    $files{$_} = 1 if $in_listing;
+}
+
+# Every create committed before the crash must be present.  The
+# torn commit for file6 and everything after it must be absent.
+for my $i (0...5) {
+    fail "file$i is missing after journal replay\n"
+      if !exists $files{"file$i"};
+}
+for my $i (6...11) {
+    fail "file$i is present although its commit never completed\n"
+      if exists $files{"file$i"};
+}
+pass;
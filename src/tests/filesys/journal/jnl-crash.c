@@ -0,0 +1,25 @@
+/* Creates files one at a time while the kernel is set up to
+   simulate a crash partway through writing the journal commit
+   for "file6".  The files created before it must survive the
+   crash; see jnl-crash-persistence.ck. */
+
+#include <stdio.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_CNT 12
+
+void
+test_main (void) 
+{
+  int i;
+
+  for (i = 0; i < FILE_CNT; i++) 
+    {
+      char file_name[16];
+
+      snprintf (file_name, sizeof file_name, "file%d", i);
+      CHECK (create (file_name, 0), "create \"%s\"", file_name);
+    }
+}
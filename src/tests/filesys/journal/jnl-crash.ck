@@ -0,0 +1,17 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+our ($test);
+my (@output) = read_text_file ("$test.output");
+common_checks ("run", @output);
+
+# The kernel powers off in the middle of creating file6, so the
+# test never finishes.
+my (@created) = grep (/^\(jnl-crash\) create "file\d+"$/, @output);
+fail "expected creates of file0 through file6 before the crash, "
+  . "found " . scalar (@created) . " creates\n"
+  if @created != 7;
+fail "kernel did not simulate a crash during journal commit 8\n"
+  if !grep (/^journal: simulating crash during commit 8$/, @output);
+pass;
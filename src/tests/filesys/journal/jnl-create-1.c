@@ -0,0 +1,9 @@
+/* Creates and removes 64 files from a single process.  Together
+   with jnl-create-8, measures how well the journal groups
+   metadata updates from concurrent creators into shared commits:
+   compare creates per second, which the checker reports, and
+   handles per transaction, from the "Journal" line printed at
+   shutdown. */
+
+#define CHILD_CNT 1
+#include "tests/filesys/journal/jnl-create.inc"
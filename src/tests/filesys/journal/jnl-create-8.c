@@ -0,0 +1,5 @@
+/* Creates and removes 64 files from 8 concurrent processes.  See
+   jnl-create-1 for how to read the results. */
+
+#define CHILD_CNT 8
+#include "tests/filesys/journal/jnl-create.inc"
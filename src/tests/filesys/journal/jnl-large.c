@@ -0,0 +1,33 @@
+/* Creates, fills in, and removes a file big enough that its
+   data covers several sectors of the free map, on a file system
+   much larger than the log.  The journal must be able to commit
+   each of these operations as a single transaction. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+/* Size of the big file, in bytes. */
+#define BIG_SIZE (8 * 1024 * 1024)
+
+void
+test_main (void) 
+{
+  static const char magic[] = "the end";
+  char buf[sizeof magic];
+  int fd;
+
+  CHECK (create ("big", BIG_SIZE), "create \"big\"");
+  CHECK ((fd = open ("big")) > 1, "open \"big\"");
+  seek (fd, BIG_SIZE - sizeof magic);
+  CHECK (write (fd, magic, sizeof magic) == sizeof magic,
+         "write end of \"big\"");
+  seek (fd, BIG_SIZE - sizeof magic);
+  CHECK (read (fd, buf, sizeof buf) == sizeof buf, "read end of \"big\"");
+  CHECK (!strcmp (buf, magic), "compare end of \"big\"");
+  close (fd);
+  CHECK (remove ("big"), "remove \"big\"");
+  CHECK (create ("small", 0), "create \"small\"");
+  CHECK (create ("big", BIG_SIZE), "create \"big\" again");
+}
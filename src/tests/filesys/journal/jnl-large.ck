@@ -0,0 +1,17 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(jnl-large) begin
+(jnl-large) create "big"
+(jnl-large) open "big"
+(jnl-large) write end of "big"
+(jnl-large) read end of "big"
+(jnl-large) compare end of "big"
+(jnl-large) remove "big"
+(jnl-large) create "small"
+(jnl-large) create "big" again
+(jnl-large) end
+EOF
+pass;
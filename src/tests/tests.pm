@@ -177,6 +177,8 @@ sub compare_output {
 			&& !/^ esi=.* edi=.* esp=.* ebp=.*/
 			&& !/^ cs=.* ds=.* es=.* ss=.*/, @output);
     }
+    my $ignore_numbers = exists $options{IGNORE_NUMBERS};
+    delete $options{IGNORE_NUMBERS} if $ignore_numbers;
     die "unknown option " . (keys (%options))[0] . "\n" if %options;
 
     my ($msg);
@@ -188,23 +190,25 @@ sub compare_output {
     }
     foreach my $key (keys %$expected) {
 	my (@expected) = split ("\n", $expected->{$key});
+	my (@actual) = $ignore_numbers
+	  ? match_numbers (\@expected, @output) : @output;
 
 	$msg .= "Acceptable output:\n";
 	$msg .= join ('', map ("  $_\n", @expected));
 
 	# Check whether actual and expected match.
 	# If it's a perfect match, we're done.
-	if ($#output == $#expected) {
+	if ($#actual == $#expected) {
 	    my ($eq) = 1;
 	    for (my ($i) = 0; $i <= $#expected; $i++) {
-		$eq = 0 if $output[$i] ne $expected[$i];
+		$eq = 0 if $actual[$i] ne $expected[$i];
 	    }
 	    return $key if $eq;
 	}
 
 	# They differ.  Output a diff.
 	my (@diff) = "";
-	my ($d) = Algorithm::Diff->new (\@expected, \@output);
+	my ($d) = Algorithm::Diff->new (\@expected, \@actual);
 	while ($d->Next ()) {
 	    my ($ef, $el, $af, $al) = $d->Get (qw (min1 max1 min2 max2));
 	    if ($d->Same ()) {
@@ -224,8 +228,31 @@ sub compare_output {
       if $ignore_exit_codes;
     $msg .= "\n(User fault messages are excluded for matching purposes.)\n"
       if $ignore_user_faults;
+    $msg .= "\n(Each `#' in an acceptable output matches any number.)\n"
+      if $ignore_numbers;
     fail "Test output failed to match any acceptable form.\n\n$msg";
 }
+
+# match_numbers (\@EXPECTED, @OUTPUT)
+#
+# Returns @OUTPUT with each line that matches a line in @EXPECTED,
+# taking each `#' in @EXPECTED to stand for any number, replaced
+# by that line of @EXPECTED.  Everything else must match exactly.
+sub match_numbers {
+    my ($expected, @output) = @_;
+    my (@patterns);
+    foreach my $line (grep (/#/, @$expected)) {
+	my ($re) = quotemeta ($line);
+	$re =~ s/\\#/-?\\d+/g;
+	push (@patterns, [qr/^$re$/, $line]);
+    }
+    foreach my $line (@output) {
+	foreach my $p (@patterns) {
+	    $line = $p->[1], last if $line =~ $p->[0];
+	}
+    }
+    return @output;
+}
 
 # File system extraction.
 
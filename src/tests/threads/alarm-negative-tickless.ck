@@ -0,0 +1,10 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(alarm-negative-tickless) begin
+(alarm-negative-tickless) PASS
+(alarm-negative-tickless) end
+EOF
+pass;
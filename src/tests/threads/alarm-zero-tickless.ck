@@ -0,0 +1,10 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(alarm-zero-tickless) begin
+(alarm-zero-tickless) PASS
+(alarm-zero-tickless) end
+EOF
+pass;
@@ -0,0 +1,144 @@
+/* Measures the fairness and overhead of the completely fair
+   scheduler.
+
+   The cfs-fair-4 test runs 4 CPU-bound threads all niced to 0,
+   which should receive equal shares of the CPU.  The cfs-nice-3
+   test runs 3 threads niced to 0, 5, and 10, which should receive
+   shares in proportion to their weights, about 70%, 23%, and 7%.
+   Each thread counts the timer ticks during which it was running
+   over SPIN_SECONDS seconds.  The test reports each thread's
+   count next to the count expected from the weights, and the
+   variance of the counts from the expected ones.
+
+   Then, two threads yield to each other SWITCH_CNT times each,
+   to measure the cost of a thread switch through the scheduler. */
+
+#include <stdio.h>
+#include <inttypes.h>
+#include "tests/threads/tests.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+#define MAX_THREAD_CNT 10
+
+/* Seconds for which the threads compete. */
+#define SPIN_SECONDS 20
+
+/* Number of times each thread yields in the switch benchmark. */
+#define SWITCH_CNT 10000
+
+struct thread_info 
+  {
+    int64_t start_time;
+    int tick_count;
+    int nice;
+  };
+
+static void test_cfs_fair (int thread_cnt, int nice_min, int nice_step);
+static thread_func load_thread, yield_thread;
+
+void
+test_cfs_fair_4 (void) 
+{
+  test_cfs_fair (4, 0, 0);
+}
+
+void
+test_cfs_nice_3 (void) 
+{
+  test_cfs_fair (3, 0, 5);
+}
+
+static void
+test_cfs_fair (int thread_cnt, int nice_min, int nice_step) 
+{
+  struct thread_info info[MAX_THREAD_CNT];
+  struct semaphore done;
+  int64_t start_time, variance, elapsed;
+  int total_ticks, total_weight;
+  int i;
+
+  ASSERT (thread_cfs);
+  ASSERT (thread_cnt <= MAX_THREAD_CNT);
+
+  thread_set_nice (NICE_MIN);
+
+  start_time = timer_ticks ();
+  msg ("Starting %d threads...", thread_cnt);
+  total_weight = 0;
+  for (i = 0; i < thread_cnt; i++) 
+    {
+      struct thread_info *ti = &info[i];
+      char name[16];
+
+      ti->start_time = start_time;
+      ti->tick_count = 0;
+      ti->nice = nice_min + i * nice_step;
+      total_weight += thread_nice_weight (ti->nice);
+
+      snprintf (name, sizeof name, "load %d", i);
+      thread_create (name, PRI_DEFAULT, load_thread, ti);
+    }
+
+  msg ("Sleeping %d seconds to let threads run, please wait...",
+       SPIN_SECONDS + 7);
+  timer_sleep ((SPIN_SECONDS + 7) * TIMER_FREQ);
+
+  total_ticks = 0;
+  for (i = 0; i < thread_cnt; i++)
+    total_ticks += info[i].tick_count;
+  variance = 0;
+  for (i = 0; i < thread_cnt; i++) 
+    {
+      int expected = ((int64_t) total_ticks
+                      * thread_nice_weight (info[i].nice) / total_weight);
+      int diff = info[i].tick_count - expected;
+
+      msg ("Thread %d (nice %d) received %d ticks, expected %d.",
+           i, info[i].nice, info[i].tick_count, expected);
+      variance += diff * diff;
+    }
+  msg ("Variance from expected shares: %"PRId64" ticks^2.",
+       variance / thread_cnt);
+
+  /* Switch benchmark. */
+  sema_init (&done, 0);
+  elapsed = timer_ns ();
+  thread_create ("yield 0", PRI_DEFAULT, yield_thread, &done);
+  thread_create ("yield 1", PRI_DEFAULT, yield_thread, &done);
+  sema_down (&done);
+  sema_down (&done);
+  elapsed = timer_ns () - elapsed;
+  msg ("%d switches: %"PRId64" ns/switch.",
+       SWITCH_CNT * 2, elapsed / (SWITCH_CNT * 2));
+}
+
+static void
+load_thread (void *ti_) 
+{
+  struct thread_info *ti = ti_;
+  int64_t sleep_time = 5 * TIMER_FREQ;
+  int64_t spin_time = sleep_time + SPIN_SECONDS * TIMER_FREQ;
+  int64_t last_time = 0;
+
+  thread_set_nice (ti->nice);
+  timer_sleep (sleep_time - timer_elapsed (ti->start_time));
+  while (timer_elapsed (ti->start_time) < spin_time) 
+    {
+      int64_t cur_time = timer_ticks ();
+      if (cur_time != last_time)
+        ti->tick_count++;
+      last_time = cur_time;
+    }
+}
+
+static void
+yield_thread (void *done) 
+{
+  int i;
+
+  for (i = 0; i < SWITCH_CNT; i++)
+    thread_yield ();
+  sema_up (done);
+}
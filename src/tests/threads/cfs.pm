@@ -0,0 +1,64 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+
+# Weights that the completely fair scheduler gives nice values
+# -20 through 20.
+my (@cfs_weights) = (88761, 71755, 56483, 46273, 36291,
+		     29154, 23254, 18705, 14949, 11916,
+		     9548, 7620, 6100, 4904, 3906,
+		     3121, 2501, 1991, 1586, 1277,
+		     1024, 820, 655, 526, 423,
+		     335, 272, 215, 172, 137,
+		     110, 87, 70, 56, 45,
+		     36, 29, 23, 18, 15,
+		     12);
+
+# Checks that each of the threads, niced to the values in @$NICE,
+# received its weight's share of the ticks that all of them
+# received, within $MAXDIFF ticks.  The variance line restates
+# that result and the switch cost depends on the host, so those
+# two lines need only be there.
+sub check_cfs_fair {
+    my ($nice, $maxdiff) = @_;
+    our ($test);
+    my (@output) = read_text_file ("$test.output");
+    common_checks ("run", @output);
+    @output = get_core_output ("run", @output);
+
+    my (@actual);
+    local ($_);
+    foreach (@output) {
+	my ($id, $count) = /Thread (\d+) \(nice -?\d+\) received (\d+) ticks/
+	  or next;
+	$actual[$id] = $count;
+    }
+
+    my ($total) = 0;
+    my ($total_weight) = 0;
+    for my $i (0...$#$nice) {
+	fail "Thread ${i}'s tick count is missing.\n" if !defined $actual[$i];
+	$total += $actual[$i];
+	$total_weight += $cfs_weights[$nice->[$i] + 20];
+    }
+
+    my (@diffs);
+    for my $i (0...$#$nice) {
+	my ($expected) = $total * $cfs_weights[$nice->[$i] + 20] / $total_weight;
+	push (@diffs, sprintf ("thread %d: %d ticks, expected %.0f",
+			       $i, $actual[$i], $expected))
+	  if abs ($actual[$i] - $expected) > $maxdiff;
+    }
+    fail "Some tick counts differed from those expected by more than "
+      . "$maxdiff:\n" . join ("\n", @diffs) . "\n"
+      if @diffs;
+
+    fail "missing variance line\n"
+      if !grep (/Variance from expected shares: \d+ ticks\^2\.$/, @output);
+    fail "missing switch timing line\n"
+      if !grep (/\d+ switches: \d+ ns\/switch\.$/, @output);
+    pass;
+}
+
+1;
@@ -0,0 +1,23 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+
+# Both bursts must come out whole and in order.  How many ticks
+# each took depends on the emulator's serial port, so any count
+# is accepted.
+my ($expected) = "(console-burst) begin\n";
+foreach my $method ('putchar', 'putbuf') {
+    for my $i (0...127) {
+	my ($line) = sprintf ("burst %s %03d ", $method, $i);
+	$expected .= $line . ('.' x (79 - length ($line))) . "\n";
+    }
+}
+$expected .= <<'EOF';
+(console-burst) 10240 bytes a character at a time: # ticks
+(console-burst) 10240 bytes a line at a time: # ticks
+(console-burst) PASS
+(console-burst) end
+EOF
+check_expected (IGNORE_NUMBERS => 1, [$expected]);
+pass;
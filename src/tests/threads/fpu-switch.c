@@ -0,0 +1,98 @@
+/* Measures the cost of a thread switch when neither, one, or
+   both of two threads use the FPU, and checks that each thread's
+   FPU registers survive the switches.
+
+   Two threads yield to each other SWITCH_CNT times each.  A
+   thread that uses the FPU keeps a running count on the x87
+   register stack, adding 1 to it before each yield, and checks
+   the count at the end.  With lazy FPU switching, a thread that
+   is alone in using the FPU should switch about as fast as one
+   that does not use it at all, and only switches between two FPU
+   users should pay for saving and restoring FPU state. */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+/* Number of times each thread yields. */
+#define SWITCH_CNT 10000
+
+/* One of the two threads. */
+struct yielder 
+  {
+    bool use_fpu;               /* Use the FPU between yields? */
+    int count;                  /* Count kept in the FPU. */
+    struct semaphore *done;     /* Up'd when finished. */
+  };
+
+static int64_t run (int fpu_cnt);
+static thread_func yielder;
+
+void
+test_fpu_switch (void) 
+{
+  int64_t none = run (0);
+  int64_t one = run (1);
+  int64_t two = run (2);
+
+  msg ("%d switches: %"PRId64" ns/switch without FPU, "
+       "%"PRId64" with one FPU thread, %"PRId64" with two",
+       SWITCH_CNT * 2, none, one, two);
+}
+
+/* Runs two yielding threads, FPU_CNT of which use the FPU, and
+   returns the average time per switch in nanoseconds. */
+static int64_t
+run (int fpu_cnt) 
+{
+  struct yielder y[2];
+  struct semaphore done;
+  int64_t start, elapsed;
+  int i;
+
+  sema_init (&done, 0);
+  for (i = 0; i < 2; i++) 
+    {
+      y[i].use_fpu = i < fpu_cnt;
+      y[i].count = 0;
+      y[i].done = &done;
+    }
+
+  start = timer_cycles ();
+  thread_create ("yielder 0", PRI_DEFAULT, yielder, &y[0]);
+  thread_create ("yielder 1", PRI_DEFAULT, yielder, &y[1]);
+  sema_down (&done);
+  sema_down (&done);
+  elapsed = timer_cycles_to_ns (timer_cycles () - start);
+
+  for (i = 0; i < fpu_cnt; i++)
+    if (y[i].count != SWITCH_CNT)
+      fail ("FPU state lost: thread %d counted %d of %d yields",
+            i, y[i].count, SWITCH_CNT);
+  return elapsed / (SWITCH_CNT * 2);
+}
+
+static void
+yielder (void *y_) 
+{
+  struct yielder *y = y_;
+  int i;
+
+  if (y->use_fpu) 
+    {
+      asm volatile ("fldz");
+      for (i = 0; i < SWITCH_CNT; i++) 
+        {
+          asm volatile ("fld1; faddp");
+          thread_yield ();
+        }
+      asm volatile ("fistpl %0" : "=m" (y->count));
+    }
+  else
+    for (i = 0; i < SWITCH_CNT; i++)
+      thread_yield ();
+  sema_up (y->done);
+}
@@ -0,0 +1,10 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_NUMBERS => 1, [<<'EOF']);
+(fpu-switch) begin
+(fpu-switch) 10000 switches: # ns/switch without FPU, # with one FPU thread, # with two
+(fpu-switch) end
+EOF
+pass;
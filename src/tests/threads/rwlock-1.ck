@@ -0,0 +1,10 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_NUMBERS => 1, [<<'EOF']);
+(rwlock-1) begin
+(rwlock-1) 1 readers, 1 writer: # reads/tick with lock, # with rwlock, # with seqlock
+(rwlock-1) end
+EOF
+pass;
@@ -0,0 +1,10 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_NUMBERS => 1, [<<'EOF']);
+(rwlock-16) begin
+(rwlock-16) 16 readers, 1 writer: # reads/tick with lock, # with rwlock, # with seqlock
+(rwlock-16) end
+EOF
+pass;
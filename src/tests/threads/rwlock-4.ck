@@ -0,0 +1,10 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_NUMBERS => 1, [<<'EOF']);
+(rwlock-4) begin
+(rwlock-4) 4 readers, 1 writer: # reads/tick with lock, # with rwlock, # with seqlock
+(rwlock-4) end
+EOF
+pass;
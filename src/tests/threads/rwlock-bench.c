@@ -0,0 +1,216 @@
+/* Measures reader throughput of a lock, a reader-writer lock,
+   and a sequence lock protecting the same small structure.
+
+   The rwlock-1, rwlock-4 and rwlock-16 tests each start 1, 4,
+   or 16 reader threads and one writer thread, and run them for
+   RUN_TICKS timer ticks with each kind of lock in turn.  Readers
+   read the structure as fast as they can and check that they
+   never see it half-updated.  The writer updates it about once
+   per tick, taking a little while to do so.  The number of reads
+   per tick is reported for each kind of lock; it should be
+   highest for the sequence lock and lowest for the plain lock,
+   with the gap growing with the number of readers. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/interrupt.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+/* Ticks to run each kind of lock for. */
+#define RUN_TICKS 100
+
+/* Microseconds that the writer spends on each update. */
+#define WRITE_US 500
+
+/* Kinds of lock to compare. */
+enum lock_kind
+  {
+    USE_LOCK,
+    USE_RWLOCK,
+    USE_SEQLOCK
+  };
+
+/* State shared by the readers and writer of one run. */
+struct bench 
+  {
+    enum lock_kind kind;        /* Kind of lock in use. */
+    struct lock lock;           /* For USE_LOCK. */
+    struct rwlock rwlock;       /* For USE_RWLOCK. */
+    struct seqlock seqlock;     /* For USE_SEQLOCK. */
+    int64_t a, b;               /* Protected data, always equal. */
+    int64_t end;                /* Tick at which to stop. */
+    long long read_cnt;         /* Reads completed by all readers. */
+    int torn_cnt;               /* Reads that saw A != B. */
+    struct semaphore done;      /* Up'd by each thread as it finishes. */
+  };
+
+static void test_rwlock (int reader_cnt);
+static long long run (enum lock_kind, int reader_cnt);
+static thread_func reader, writer;
+
+void
+test_rwlock_1 (void) 
+{
+  test_rwlock (1);
+}
+
+void
+test_rwlock_4 (void) 
+{
+  test_rwlock (4);
+}
+
+void
+test_rwlock_16 (void) 
+{
+  test_rwlock (16);
+}
+
+static void
+test_rwlock (int reader_cnt) 
+{
+  long long lock_reads = run (USE_LOCK, reader_cnt);
+  long long rwlock_reads = run (USE_RWLOCK, reader_cnt);
+  long long seqlock_reads = run (USE_SEQLOCK, reader_cnt);
+
+  msg ("%d readers, 1 writer: %lld reads/tick with lock, "
+       "%lld with rwlock, %lld with seqlock",
+       reader_cnt, lock_reads / RUN_TICKS, rwlock_reads / RUN_TICKS,
+       seqlock_reads / RUN_TICKS);
+}
+
+/* Runs READER_CNT readers and a writer using KIND of lock for
+   RUN_TICKS ticks, and returns the total number of reads. */
+static long long
+run (enum lock_kind kind, int reader_cnt) 
+{
+  static const char *kind_names[] = {"lock", "rwlock", "seqlock"};
+  struct bench b;
+  int i;
+
+  b.kind = kind;
+  lock_init (&b.lock);
+  rwlock_init (&b.rwlock);
+  seqlock_init (&b.seqlock);
+  b.a = b.b = 0;
+  b.read_cnt = 0;
+  b.torn_cnt = 0;
+  sema_init (&b.done, 0);
+
+  /* Start all the threads on a tick boundary. */
+  timer_sleep (1);
+  b.end = timer_ticks () + RUN_TICKS;
+  for (i = 0; i < reader_cnt; i++) 
+    {
+      char name[sizeof "reader " + 11];    /* 11 = strlen ("-2147483648"). */
+      snprintf (name, sizeof name, "reader %d", i);
+      thread_create (name, PRI_DEFAULT, reader, &b);
+    }
+  thread_create ("writer", PRI_DEFAULT, writer, &b);
+
+  for (i = 0; i < reader_cnt + 1; i++)
+    sema_down (&b.done);
+
+  if (b.torn_cnt != 0)
+    fail ("%d of %lld reads with %s saw a partial update",
+          b.torn_cnt, b.read_cnt, kind_names[kind]);
+  return b.read_cnt;
+}
+
+static void
+reader (void *b_) 
+{
+  struct bench *b = b_;
+  long long read_cnt = 0;
+  int torn_cnt = 0;
+  enum intr_level old_level;
+
+  while (timer_ticks () < b->end) 
+    {
+      int64_t a, c;
+
+      switch (b->kind) 
+        {
+        case USE_LOCK:
+          lock_acquire (&b->lock);
+          a = b->a;
+          c = b->b;
+          lock_release (&b->lock);
+          break;
+
+        case USE_RWLOCK:
+          rwlock_acquire_read (&b->rwlock);
+          a = b->a;
+          c = b->b;
+          rwlock_release_read (&b->rwlock);
+          break;
+
+        default:
+          {
+            unsigned start;
+            do 
+              {
+                start = seqlock_read_begin (&b->seqlock);
+                a = b->a;
+                c = b->b;
+              }
+            while (seqlock_read_retry (&b->seqlock, start));
+          }
+          break;
+        }
+
+      if (a != c)
+        torn_cnt++;
+      read_cnt++;
+    }
+
+  old_level = intr_disable ();
+  b->read_cnt += read_cnt;
+  b->torn_cnt += torn_cnt;
+  intr_set_level (old_level);
+  sema_up (&b->done);
+}
+
+static void
+writer (void *b_) 
+{
+  struct bench *b = b_;
+  enum intr_level old_level;
+
+  while (timer_ticks () < b->end) 
+    {
+      switch (b->kind) 
+        {
+        case USE_LOCK:
+          lock_acquire (&b->lock);
+          b->a++;
+          timer_udelay (WRITE_US);
+          b->b++;
+          lock_release (&b->lock);
+          break;
+
+        case USE_RWLOCK:
+          rwlock_acquire_write (&b->rwlock);
+          b->a++;
+          timer_udelay (WRITE_US);
+          b->b++;
+          rwlock_release_write (&b->rwlock);
+          break;
+
+        default:
+          /* Sequence lock writers must keep interrupts off. */
+          old_level = intr_disable ();
+          seqlock_write_begin (&b->seqlock);
+          b->a++;
+          timer_udelay (WRITE_US);
+          b->b++;
+          seqlock_write_end (&b->seqlock);
+          intr_set_level (old_level);
+          break;
+        }
+      timer_sleep (1);
+    }
+  sema_up (&b->done);
+}
@@ -38,6 +38,20 @@ static const struct test tests[] =
     {"mlfqs-nice-2", test_mlfqs_nice_2},
     {"mlfqs-nice-10", test_mlfqs_nice_10},
     {"mlfqs-block", test_mlfqs_block},
+    {"console-burst", test_console_burst},
+    {"timer-wheel", test_timer_wheel},
+    {"rwlock-1", test_rwlock_1},
+    {"rwlock-4", test_rwlock_4},
+    {"rwlock-16", test_rwlock_16},
+    {"fpu-switch", test_fpu_switch},
+    {"cfs-fair-4", test_cfs_fair_4},
+    {"cfs-nice-3", test_cfs_nice_3},
+    {"alarm-single-tickless", test_alarm_single},
+    {"alarm-multiple-tickless", test_alarm_multiple},
+    {"alarm-simultaneous-tickless", test_alarm_simultaneous},
+    {"alarm-zero-tickless", test_alarm_zero},
+    {"alarm-negative-tickless", test_alarm_negative},
+    {"timer-wheel-tickless", test_timer_wheel},
   };
 
 static const char *test_name;
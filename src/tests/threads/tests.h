@@ -32,6 +32,14 @@ extern test_func test_mlfqs_fair_20;
 extern test_func test_mlfqs_nice_2;
 extern test_func test_mlfqs_nice_10;
 extern test_func test_mlfqs_block;
+extern test_func test_console_burst;
+extern test_func test_timer_wheel;
+extern test_func test_rwlock_1;
+extern test_func test_rwlock_4;
+extern test_func test_rwlock_16;
+extern test_func test_fpu_switch;
+extern test_func test_cfs_fair_4;
+extern test_func test_cfs_nice_3;
 
 void msg (const char *, ...);
 void fail (const char *, ...);
@@ -0,0 +1,14 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(timer-wheel-tickless) begin
+(timer-wheel-tickless) sema_down_timeout() timed out
+(timer-wheel-tickless) cond_wait_timeout() timed out
+(timer-wheel-tickless) cond_wait_timeout() was signaled
+(timer-wheel-tickless) armed 100000 timers, at most 10000 at once
+(timer-wheel-tickless) all fired on time or were canceled
+(timer-wheel-tickless) end
+EOF
+pass;
@@ -0,0 +1,156 @@
+/* Stress test for timer callbacks.  Keeps TIMER_CNT timers
+   pending at once, re-arming each from its own callback at a
+   random delay and canceling a random other timer every so
+   often, until ARM_CNT timers have been armed.  Every callback
+   must run at exactly the tick its timer was armed for.
+
+   Also checks that sema_down_timeout() and cond_wait_timeout()
+   time out, and that cond_wait_timeout() sees a signal that
+   arrives in time. */
+
+#include <random.h>
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/interrupt.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+/* Number of timers pending at once. */
+#define TIMER_CNT 10000
+
+/* Number of times to arm a timer, in all. */
+#define ARM_CNT 100000
+
+/* Longest delay, in ticks.  Longer than two turns of the lowest
+   level of the timer wheel, so that timers get cascaded. */
+#define MAX_DELAY 130
+
+/* Cancel a random timer once every CANCEL_INTERVAL arms. */
+#define CANCEL_INTERVAL 8
+
+struct stress_timer
+  {
+    struct timer timer;
+    int64_t expires;
+  };
+
+static struct stress_timer *timers;
+static int arm_cnt, fire_cnt, cancel_cnt, wrong_tick_cnt;
+static struct semaphore done;
+
+static void arm_timer (struct stress_timer *);
+static timer_func stress_timer_expired;
+static void check_timeouts (void);
+
+void
+test_timer_wheel (void) 
+{
+  enum intr_level old_level;
+  int i;
+
+  check_timeouts ();
+
+  timers = malloc (TIMER_CNT * sizeof *timers);
+  if (timers == NULL)
+    fail ("couldn't allocate %d timers", TIMER_CNT);
+
+  sema_init (&done, 0);
+  random_init (0);
+  old_level = intr_disable ();
+  for (i = 0; i < TIMER_CNT; i++)
+    timer_setup (&timers[i].timer, stress_timer_expired, &timers[i]);
+  for (i = 0; i < TIMER_CNT; i++)
+    arm_timer (&timers[i]);
+  intr_set_level (old_level);
+
+  if (!sema_down_timeout (&done, 60 * TIMER_FREQ))
+    fail ("only %d of %d timers fired or were canceled in 60 seconds",
+          fire_cnt + cancel_cnt, ARM_CNT);
+  msg ("armed %d timers, at most %d at once", arm_cnt, TIMER_CNT);
+  if (wrong_tick_cnt != 0)
+    fail ("%d of %d timers fired at the wrong tick",
+          wrong_tick_cnt, fire_cnt);
+  msg ("all fired on time or were canceled");
+
+  free (timers);
+}
+
+/* Arms ST to fire after a random delay.  Called with interrupts
+   off. */
+static void
+arm_timer (struct stress_timer *st) 
+{
+  st->expires = timer_ticks () + random_ulong () % MAX_DELAY + 1;
+  timer_arm (&st->timer, st->expires);
+  arm_cnt++;
+}
+
+static void
+stress_timer_expired (struct timer *t UNUSED, void *st_) 
+{
+  struct stress_timer *st = st_;
+
+  fire_cnt++;
+  if (timer_ticks () != st->expires)
+    wrong_tick_cnt++;
+
+  if (arm_cnt < ARM_CNT)
+    arm_timer (st);
+  if (arm_cnt % CANCEL_INTERVAL == 0 && arm_cnt < ARM_CNT)
+    {
+      struct stress_timer *victim = &timers[random_ulong () % TIMER_CNT];
+      if (timer_cancel (&victim->timer))
+        {
+          cancel_cnt++;
+          arm_timer (victim);
+        }
+    }
+
+  if (fire_cnt + cancel_cnt == ARM_CNT)
+    sema_up (&done);
+}
+
+static struct lock lock;
+static struct condition cond;
+
+static void
+signal_thread (void *aux UNUSED) 
+{
+  timer_sleep (5);
+  lock_acquire (&lock);
+  cond_signal (&cond, &lock);
+  lock_release (&lock);
+}
+
+static void
+check_timeouts (void) 
+{
+  struct semaphore sema;
+  int64_t start;
+
+  sema_init (&sema, 0);
+  start = timer_ticks ();
+  if (sema_down_timeout (&sema, 10))
+    fail ("sema_down_timeout() downed a 0 semaphore");
+  if (timer_elapsed (start) < 10)
+    fail ("sema_down_timeout() returned early");
+  msg ("sema_down_timeout() timed out");
+
+  lock_init (&lock);
+  cond_init (&cond);
+  lock_acquire (&lock);
+  start = timer_ticks ();
+  if (cond_wait_timeout (&cond, &lock, 10))
+    fail ("cond_wait_timeout() returned true with no signal");
+  if (timer_elapsed (start) < 10)
+    fail ("cond_wait_timeout() returned early");
+  msg ("cond_wait_timeout() timed out");
+
+  thread_create ("signal", PRI_DEFAULT, signal_thread, NULL);
+  if (!cond_wait_timeout (&cond, &lock, 10 * TIMER_FREQ))
+    fail ("cond_wait_timeout() missed a signal");
+  lock_release (&lock);
+  msg ("cond_wait_timeout() was signaled");
+}
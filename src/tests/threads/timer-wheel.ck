@@ -0,0 +1,14 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(timer-wheel) begin
+(timer-wheel) sema_down_timeout() timed out
+(timer-wheel) cond_wait_timeout() timed out
+(timer-wheel) cond_wait_timeout() was signaled
+(timer-wheel) armed 100000 timers, at most 10000 at once
+(timer-wheel) all fired on time or were canceled
+(timer-wheel) end
+EOF
+pass;
@@ -0,0 +1,234 @@
+#include "threads/fpu.h"
+#include <debug.h>
+#include <round.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/interrupt.h"
+#include "threads/malloc.h"
+#include "threads/thread.h"
+
+/* Lazy FPU context switching.
+
+   switch_threads() saves only the integer registers.  Instead of
+   also saving and restoring the x87 and SSE registers on every
+   thread switch, we leave them loaded and remember which thread
+   they belong to, the "FPU owner".  On a switch to any other
+   thread, the CR0.TS flag is set, so that the thread's first
+   FPU or SSE instruction raises a device-not-available (#NM)
+   exception.  The handler saves the registers into the owner's
+   save area, loads the faulting thread's registers from its own
+   save area, clears CR0.TS, and makes that thread the owner.
+
+   Thus, a thread that never uses the FPU never pays for saving or
+   restoring its state and has no save area, and a thread that is
+   the only one using the FPU pays nothing after its first use.
+   Switches between two threads that both use the FPU cost one
+   exception and one save and restore each.
+
+   Kernel code is compiled with -msoft-float, so in practice only
+   user programs use the FPU. */
+
+/* CR0 and CR4 flags.  See [IA32-v3a] sections 2.5 and 9.6. */
+#define CR0_MP 0x00000002       /* Monitor Coprocessor. */
+#define CR0_EM 0x00000004       /* (Floating-point) Emulation. */
+#define CR0_TS 0x00000008       /* Task Switched. */
+#define CR0_NE 0x00000020       /* Numeric Error. */
+#define CR4_OSFXSR 0x00000200   /* FXSAVE and FXRSTOR support. */
+#define CR4_OSXMMEXCPT 0x00000400 /* Unmasked SSE exception support. */
+
+/* Size and alignment of a save area for FXSAVE.  FSAVE, used
+   on CPUs without FXSAVE, needs less space and alignment. */
+#define AREA_SIZE 512
+#define AREA_ALIGN 16
+
+/* True if the CPU supports FXSAVE and FXRSTOR, and thus SSE. */
+static bool fxsr;
+
+/* Thread whose state is in the FPU registers, or null. */
+static struct thread *fpu_owner;
+
+/* Whether CR0.TS is set, to avoid needless CR0 writes. */
+static bool ts_set;
+
+/* Initial state of the FPU, loaded on a thread's first use. */
+static uint8_t initial_area[AREA_SIZE] __attribute__ ((aligned (AREA_ALIGN)));
+
+/* Statistics. */
+static long long trap_cnt;      /* # of #NM exceptions. */
+static long long save_cnt;      /* # of times state was saved. */
+
+static intr_handler_func device_not_available;
+static bool have_fxsr (void);
+static void *thread_area (struct thread *);
+static void save (void *area);
+static void restore (void *area);
+static void set_ts (bool);
+
+/* Enables the FPU and SSE with lazy context switching. */
+void
+fpu_init (void) 
+{
+  uint32_t cr0, cr4;
+  uint32_t mxcsr = 0x1f80;      /* All SSE exceptions masked. */
+
+  fxsr = have_fxsr ();
+  if (fxsr) 
+    {
+      asm volatile ("movl %%cr4, %0" : "=r" (cr4));
+      cr4 |= CR4_OSFXSR | CR4_OSXMMEXCPT;
+      asm volatile ("movl %0, %%cr4" : : "r" (cr4));
+    }
+
+  /* The loader set CR0.EM, which makes every FPU instruction
+     raise #NM.  Clear it and use CR0.TS instead. */
+  asm volatile ("movl %%cr0, %0" : "=r" (cr0));
+  cr0 = (cr0 & ~(CR0_EM | CR0_TS)) | CR0_MP | CR0_NE;
+  asm volatile ("movl %0, %%cr0" : : "r" (cr0));
+
+  asm volatile ("fninit");
+  if (fxsr)
+    asm volatile ("ldmxcsr %0" : : "m" (mxcsr));
+  save (initial_area);
+  set_ts (true);
+
+  intr_register_int (7, 0, INTR_ON, device_not_available,
+                     "#NM Device Not Available Exception");
+}
+
+/* Prepares the FPU for running thread T, which is about to run.
+   Called by thread_schedule_tail() with interrupts off. */
+void
+fpu_switch (struct thread *t) 
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  set_ts (t != fpu_owner);
+}
+
+/* Releases the running thread's FPU state.  Called by
+   thread_exit(). */
+void
+fpu_exit (void) 
+{
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+
+  old_level = intr_disable ();
+  if (fpu_owner == cur)
+    fpu_owner = NULL;
+  intr_set_level (old_level);
+
+  free (cur->fpu);
+  cur->fpu = NULL;
+}
+
+/* Prints FPU statistics. */
+void
+fpu_print_stats (void) 
+{
+  printf ("FPU: %lld lazy restores, %lld saves, %s\n",
+          trap_cnt, save_cnt, fxsr ? "FXSAVE" : "FSAVE");
+}
+
+/* Device-not-available (#NM) handler: gives the FPU to the
+   running thread. */
+static void
+device_not_available (struct intr_frame *f UNUSED) 
+{
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+
+  /* Allocate a save area on first use.  This can sleep, so do
+     it before taking over the FPU. */
+  if (cur->fpu == NULL) 
+    {
+      cur->fpu = malloc (AREA_SIZE + AREA_ALIGN - 1);
+      if (cur->fpu == NULL)
+        PANIC ("out of memory for FPU state of thread %s", cur->name);
+      memcpy (thread_area (cur), initial_area, AREA_SIZE);
+    }
+
+  old_level = intr_disable ();
+  set_ts (false);
+  if (fpu_owner != cur) 
+    {
+      if (fpu_owner != NULL) 
+        {
+          save (thread_area (fpu_owner));
+          save_cnt++;
+        }
+      restore (thread_area (cur));
+      fpu_owner = cur;
+      trap_cnt++;
+    }
+  intr_set_level (old_level);
+}
+
+/* Returns true if the CPU supports FXSAVE and FXRSTOR. */
+static bool
+have_fxsr (void) 
+{
+  uint32_t before, after;
+  uint32_t eax, ebx, ecx, edx;
+
+  /* The CPU supports CPUID if EFLAGS.ID can be toggled. */
+  asm volatile ("pushfl; popl %0; movl %0, %1; xorl $0x200000, %1; "
+                "pushl %1; popfl; pushfl; popl %1; pushl %0; popfl"
+                : "=&r" (before), "=&r" (after));
+  if (((before ^ after) & 0x200000) == 0)
+    return false;
+
+  asm volatile ("cpuid"
+                : "=a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx)
+                : "a" (1));
+  return (edx & (1u << 24)) != 0;
+}
+
+/* Returns thread T's aligned FPU save area. */
+static void *
+thread_area (struct thread *t) 
+{
+  return (void *) ROUND_UP ((uintptr_t) t->fpu, AREA_ALIGN);
+}
+
+/* Saves the FPU state into AREA.  FSAVE also reinitializes the
+   FPU, which does no harm because the FPU is reloaded before
+   its next use. */
+static void
+save (void *area) 
+{
+  if (fxsr)
+    asm volatile ("fxsave (%0)" : : "r" (area) : "memory");
+  else
+    asm volatile ("fnsave (%0)" : : "r" (area) : "memory");
+}
+
+/* Loads the FPU state from AREA. */
+static void
+restore (void *area) 
+{
+  if (fxsr)
+    asm volatile ("fxrstor (%0)" : : "r" (area) : "memory");
+  else
+    asm volatile ("frstor (%0)" : : "r" (area) : "memory");
+}
+
+/* Sets CR0.TS if TS is true, otherwise clears it. */
+static void
+set_ts (bool ts) 
+{
+  if (ts != ts_set) 
+    {
+      if (ts) 
+        {
+          uint32_t cr0;
+          asm volatile ("movl %%cr0, %0" : "=r" (cr0));
+          asm volatile ("movl %0, %%cr0" : : "r" (cr0 | CR0_TS));
+        }
+      else
+        asm volatile ("clts");
+      ts_set = ts;
+    }
+}
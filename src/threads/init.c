@@ -15,13 +15,17 @@
 #include "devices/timer.h"
 #include "devices/vga.h"
 #include "devices/rtc.h"
+#include "threads/fpu.h"
 #include "threads/interrupt.h"
 #include "threads/io.h"
 #include "threads/loader.h"
 #include "threads/malloc.h"
 #include "threads/palloc.h"
+#include "threads/profile.h"
 #include "threads/pte.h"
 #include "threads/thread.h"
+#include "threads/trace.h"
+#include "threads/workqueue.h"
 #ifdef USERPROG
 #include "userprog/process.h"
 #include "userprog/exception.h"
@@ -34,8 +38,11 @@
 #ifdef FILESYS
 #include "devices/block.h"
 #include "devices/ide.h"
+#include "devices/ramdisk.h"
+#include "devices/virtio-blk.h"
 #include "filesys/filesys.h"
 #include "filesys/fsutil.h"
+#include "filesys/journal.h"
 #endif
 
 /* Page directory with kernel mappings only. */
@@ -76,6 +83,7 @@ int main (void) NO_RETURN;
 int
 main (void)
 {
+  int64_t boot_cycles;
   char **argv;
 
   /* Clear BSS. */  
@@ -85,6 +93,10 @@ main (void)
   argv = read_command_line ();
   argv = parse_options (argv);
 
+  /* Only now is it safe to read the clock, because timer_cycles()
+     consults calibration results kept in BSS and "-no-tsc". */
+  boot_cycles = timer_cycles ();
+
   /* Initialize ourselves as a thread so we can use locks,
      then enable console locking. */
   thread_init ();
@@ -98,6 +110,8 @@ main (void)
   palloc_init (user_page_limit);
   malloc_init ();
   paging_init ();
+  profile_init ();
+  trace_init ();
 
   /* Segmentation. */
 #ifdef USERPROG
@@ -107,6 +121,7 @@ main (void)
 
   /* Initialize interrupt handlers. */
   intr_init ();
+  fpu_init ();
   timer_init ();
   kbd_init ();
   input_init ();
@@ -117,17 +132,21 @@ main (void)
 
   /* Start thread scheduler and enable interrupts. */
   thread_start ();
+  workqueue_init ();
   serial_init_queue ();
   timer_calibrate ();
 
 #ifdef FILESYS
   /* Initialize file system. */
   ide_init ();
+  virtio_blk_init ();
+  ramdisk_init ();
   locate_block_devices ();
   filesys_init (format_filesys);
 #endif
 
-  printf ("Boot complete.\n");
+  printf ("Boot complete in %'"PRId64" us.\n",
+          timer_cycles_to_ns (timer_cycles () - boot_cycles) / 1000);
   
   /* Run actions specified on kernel command line. */
   run_actions (argv);
@@ -247,6 +266,12 @@ parse_options (char **argv)
         filesys_bdev_name = value;
       else if (!strcmp (name, "-scratch"))
         scratch_bdev_name = value;
+      else if (!strcmp (name, "-jcrash"))
+        journal_set_crash (atoi (value));
+      else if (!strcmp (name, "-pio"))
+        ide_pio_only = true;
+      else if (!strcmp (name, "-ramdisk"))
+        ramdisk_kb = atoi (value);
 #ifdef VM
       else if (!strcmp (name, "-swap"))
         swap_bdev_name = value;
@@ -256,6 +281,18 @@ parse_options (char **argv)
         random_init (atoi (value));
       else if (!strcmp (name, "-mlfqs"))
         thread_mlfqs = true;
+      else if (!strcmp (name, "-cfs"))
+        thread_cfs = true;
+      else if (!strcmp (name, "-tickless"))
+        timer_tickless = true;
+      else if (!strcmp (name, "-no-tsc"))
+        timer_no_tsc = true;
+      else if (!strcmp (name, "-profile"))
+        profile_enabled = true;
+      else if (!strcmp (name, "-trace"))
+        trace_enabled = true;
+      else if (!strcmp (name, "-intr-stats"))
+        intr_stats_enabled = true;
 #ifdef USERPROG
       else if (!strcmp (name, "-ul"))
         user_page_limit = atoi (value);
@@ -315,6 +352,9 @@ run_actions (char **argv)
       {"rm", 2, fsutil_rm},
       {"extract", 1, fsutil_extract},
       {"append", 2, fsutil_append},
+      {"bench", 2, fsutil_bench},
+      {"aio", 2, fsutil_aio},
+      {"probe", 1, fsutil_probe},
 #endif
       {NULL, 0, NULL},
     };
@@ -361,6 +401,9 @@ usage (void)
           "  ls                 List files in the root directory.\n"
           "  cat FILE           Print FILE to the console.\n"
           "  rm FILE            Delete FILE.\n"
+          "  bench N            Read all of scratch device, N sectors at a time.\n"
+          "  aio N              Write and verify scratch device, N requests at once.\n"
+          "  probe              Write and verify scratch device at powers of 2.\n"
           "Use these actions indirectly via `pintos' -g and -p options:\n"
           "  extract            Untar from scratch device into file system.\n"
           "  append FILE        Append FILE to tar file on scratch device.\n"
@@ -373,12 +416,21 @@ usage (void)
           "  -f                 Format file system device during startup.\n"
           "  -filesys=BDEV      Use BDEV for file system instead of default.\n"
           "  -scratch=BDEV      Use BDEV for scratch instead of default.\n"
+          "  -jcrash=N          Simulate a crash during journal commit N.\n"
+          "  -pio               Use PIO instead of DMA for IDE disks.\n"
+          "  -ramdisk=KB        Create KB-kB RAM disk rd0, e.g. -filesys=rd0.\n"
 #ifdef VM
           "  -swap=BDEV         Use BDEV for swap instead of default.\n"
 #endif
 #endif
           "  -rs=SEED           Set random number seed to SEED.\n"
           "  -mlfqs             Use multi-level feedback queue scheduler.\n"
+          "  -cfs               Use completely fair scheduler.\n"
+          "  -tickless          Stop the timer tick while the CPU is idle.\n"
+          "  -no-tsc            Calibrate with loops, as without a TSC.\n"
+          "  -profile           Sample the running code on each timer tick.\n"
+          "  -trace             Log scheduler events and dump them at shutdown.\n"
+          "  -intr-stats        Time how long interrupts stay off.\n"
 #ifdef USERPROG
           "  -ul=COUNT          Limit user memory to COUNT pages.\n"
 #endif
@@ -7,6 +7,7 @@
 #include "threads/intr-stubs.h"
 #include "threads/io.h"
 #include "threads/thread.h"
+#include "threads/trace.h"
 #include "threads/vaddr.h"
 #include "devices/timer.h"
 
@@ -47,6 +48,28 @@ static unsigned int unexpected_cnt[INTR_CNT];
 static bool in_external_intr;   /* Are we processing an external interrupt? */
 static bool yield_on_return;    /* Should we yield on interrupt return? */
 
+/* Longest stretches with interrupts off, in timer_cycles()
+   units.  A stretch starts when intr_disable() turns interrupts
+   off or an external interrupt arrives, and ends when
+   intr_enable() turns them back on or the external interrupt
+   returns.  Interrupts turned back on some other way (the idle
+   thread's "sti; hlt", or returning to user mode) leave a stale
+   start time that the next stretch overwrites.  Kept only with
+   the "-intr-stats" kernel option, because reading the time
+   stamp counter on every intr_disable() and intr_enable() is not
+   free. */
+bool intr_stats_enabled;
+static int64_t off_start;       /* Start of current stretch, or 0. */
+static const char *off_handler; /* Interrupt that started it, or null. */
+static void *off_caller;        /* Else, caller of intr_disable(). */
+static int64_t max_handler_off; /* Longest stretch in a handler... */
+static const char *max_handler; /* ...and its interrupt's name. */
+static int64_t max_other_off;   /* Longest other stretch... */
+static void *max_caller;        /* ...and where it started. */
+
+static void off_begin (const char *handler, void *caller);
+static void off_end (void);
+
 /* Programmable Interrupt Controller helpers. */
 static void pic_init (void);
 static void pic_end_of_interrupt (int irq);
@@ -90,6 +113,9 @@ intr_enable (void)
   enum intr_level old_level = intr_get_level ();
   ASSERT (!intr_context ());
 
+  if (old_level == INTR_OFF && intr_stats_enabled)
+    off_end ();
+
   /* Enable interrupts by setting the interrupt flag.
 
      See [IA32-v2b] "STI" and [IA32-v3a] 5.8.1 "Masking Maskable
@@ -110,6 +136,9 @@ intr_disable (void)
      Hardware Interrupts". */
   asm volatile ("cli" : : : "memory");
 
+  if (old_level == INTR_ON && intr_stats_enabled)
+    off_begin (NULL, __builtin_return_address (0));
+
   return old_level;
 }
 
@@ -206,6 +235,14 @@ intr_register_int (uint8_t vec_no, int dpl, enum intr_level level,
   register_handler (vec_no, dpl, level, handler, name);
 }
 
+/* Returns the handler registered for interrupt VEC_NO, or a null
+   pointer if there is none. */
+intr_handler_func *
+intr_get_handler (uint8_t vec_no)
+{
+  return intr_handlers[vec_no];
+}
+
 /* Returns true during processing of an external interrupt
    and false at all other times. */
 bool
@@ -352,13 +389,19 @@ intr_handler (struct intr_frame *frame)
      and they need to be acknowledged on the PIC (see below).
      An external interrupt handler cannot sleep. */
   external = frame->vec_no >= 0x20 && frame->vec_no < 0x30;
+  TRACE (TRACE_INTR_ENTER, thread_current ()->tid, frame->vec_no);
   if (external) 
     {
       ASSERT (intr_get_level () == INTR_OFF);
       ASSERT (!intr_context ());
 
+      if (intr_stats_enabled)
+        off_begin (intr_names[frame->vec_no], NULL);
       in_external_intr = true;
       yield_on_return = false;
+
+      /* Restart the timer tick if the CPU was idling without it. */
+      timer_idle_exit ();
     }
 
   /* Invoke the interrupt's handler. */
@@ -380,11 +423,72 @@ intr_handler (struct intr_frame *frame)
       ASSERT (intr_get_level () == INTR_OFF);
       ASSERT (intr_context ());
 
-      in_external_intr = false;
       pic_end_of_interrupt (frame->vec_no); 
 
+      /* Run the callbacks of timers that came due, now that the
+         interrupt that made them due has been acknowledged. */
+      timer_run_expired ();
+      in_external_intr = false;
+      TRACE (TRACE_INTR_EXIT, thread_current ()->tid, frame->vec_no);
+
       if (yield_on_return) 
         thread_yield (); 
+      if (intr_stats_enabled)
+        off_end ();
+    }
+  else
+    TRACE (TRACE_INTR_EXIT, thread_current ()->tid, frame->vec_no);
+}
+
+/* Prints the longest stretches of time that interrupts have been
+   off, if they were measured. */
+void
+intr_print_stats (void) 
+{
+  if (!intr_stats_enabled)
+    return;
+  printf ("Interrupts: off for up to %"PRId64" us in a handler (%s), "
+          "%"PRId64" us elsewhere (from %p)\n",
+          timer_cycles_to_ns (max_handler_off) / 1000,
+          max_handler != NULL ? max_handler : "none",
+          timer_cycles_to_ns (max_other_off) / 1000, max_caller);
+}
+
+/* Notes that interrupts just went off, because of the external
+   interrupt named HANDLER, or else because CALLER called
+   intr_disable(). */
+static void
+off_begin (const char *handler, void *caller) 
+{
+  off_start = timer_cycles ();
+  off_handler = handler;
+  off_caller = caller;
+}
+
+/* Notes that interrupts are about to go back on, and updates the
+   longest stretches. */
+static void
+off_end (void) 
+{
+  int64_t elapsed;
+
+  if (off_start == 0)
+    return;
+  elapsed = timer_cycles () - off_start;
+  off_start = 0;
+
+  if (off_handler != NULL)
+    {
+      if (elapsed > max_handler_off)
+        {
+          max_handler_off = elapsed;
+          max_handler = off_handler;
+        }
+    }
+  else if (elapsed > max_other_off)
+    {
+      max_other_off = elapsed;
+      max_caller = off_caller;
     }
 }
 
@@ -61,10 +61,16 @@ void intr_init (void);
 void intr_register_ext (uint8_t vec, intr_handler_func *, const char *name);
 void intr_register_int (uint8_t vec, int dpl, enum intr_level,
                         intr_handler_func *, const char *name);
+intr_handler_func *intr_get_handler (uint8_t vec);
 bool intr_context (void);
 void intr_yield_on_return (void);
 
 void intr_dump_frame (const struct intr_frame *);
 const char *intr_name (uint8_t vec);
+/* If true, set by the "-intr-stats" kernel command-line option,
+   the longest stretches with interrupts off are measured and
+   printed at shutdown. */
+extern bool intr_stats_enabled;
+void intr_print_stats (void);
 
 #endif /* threads/interrupt.h */
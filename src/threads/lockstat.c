@@ -0,0 +1,171 @@
+#include "threads/lockstat.h"
+#ifdef LOCKSTAT
+#include <debug.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "threads/interrupt.h"
+#include "threads/synch.h"
+#include "devices/timer.h"
+
+/* Lock contention statistics.
+
+   In a kernel built with "make LOCKSTAT=1", lock_acquire() and
+   lock_release() record, for each combination of lock and
+   lock_acquire() call site, how often the lock was acquired and
+   how long threads waited for it and held it.  The locks that
+   were waited on the longest are printed at shutdown.  Locks and
+   call sites are printed as addresses, which the "backtrace"
+   utility can translate into names.
+
+   A lock is identified by its address, so a lock that is freed
+   and then reallocated at the same address, such as an inode's,
+   shares its record with its predecessor. */
+
+/* Number of lock/call site pairs that can be tracked.  Further
+   pairs are counted in dropped_cnt only. */
+#define LOCKSTAT_CNT 512
+
+/* Number of lock/call site pairs printed at shutdown. */
+#define PRINT_CNT 10
+
+/* Hash table of statistics, with linear probing.  Protected by
+   disabling interrupts. */
+static struct lockstat stats[LOCKSTAT_CNT];
+static size_t used_cnt;
+static unsigned long long dropped_cnt;
+
+static struct lockstat *lookup (const struct lock *, void *site);
+static int compare_wait (const void *, const void *);
+
+/* Records that the current thread has acquired LOCK, which it
+   asked for at time START (a timer_cycles() value) from SITE.
+   CONTENDED is true if the lock was held by another thread at
+   that time. */
+void
+lockstat_acquired (struct lock *lock, void *site, int64_t start,
+                   bool contended) 
+{
+  int64_t now = timer_cycles ();
+  enum intr_level old_level = intr_disable ();
+  struct lockstat *ls = lookup (lock, site);
+
+  lock->stat = ls;
+  lock->acquired = now;
+  if (ls != NULL)
+    {
+      int64_t wait = now - start;
+
+      ls->acquire_cnt++;
+      if (contended)
+        {
+          ls->contended_cnt++;
+          ls->wait_total += wait;
+          if (wait > ls->wait_max)
+            ls->wait_max = wait;
+        }
+    }
+  intr_set_level (old_level);
+}
+
+/* Records that the current thread is about to release LOCK. */
+void
+lockstat_released (struct lock *lock) 
+{
+  struct lockstat *ls = lock->stat;
+  enum intr_level old_level;
+  int64_t hold;
+
+  if (ls == NULL)
+    return;
+
+  hold = timer_cycles () - lock->acquired;
+  old_level = intr_disable ();
+  ls->hold_total += hold;
+  if (hold > ls->hold_max)
+    ls->hold_max = hold;
+  intr_set_level (old_level);
+}
+
+/* Prints the lock/call site pairs with the most waiting time. */
+void
+lockstat_print_stats (void) 
+{
+  /* Printing acquires the console lock, so work from a copy. */
+  static struct lockstat sorted[LOCKSTAT_CNT];
+  enum intr_level old_level;
+  size_t cnt, i;
+
+  old_level = intr_disable ();
+  memcpy (sorted, stats, sizeof stats);
+  cnt = used_cnt;
+  intr_set_level (old_level);
+
+  qsort (sorted, LOCKSTAT_CNT, sizeof *sorted, compare_wait);
+
+  printf ("Lockstat: %zu lock/call site pairs (%llu untracked acquisitions), "
+          "busiest:\n", cnt, dropped_cnt);
+  printf ("  %10s %10s %10s %10s %10s %10s %10s %10s\n",
+          "lock", "site", "acquired", "contended",
+          "wait us", "max", "hold us", "max");
+  for (i = 0; i < PRINT_CNT && i < cnt; i++) 
+    {
+      const struct lockstat *ls = &sorted[i];
+      printf ("  %10p %10p %10llu %10llu "
+              "%10"PRId64" %10"PRId64" %10"PRId64" %10"PRId64"\n",
+              ls->lock, ls->site, ls->acquire_cnt, ls->contended_cnt,
+              timer_cycles_to_ns (ls->wait_total) / 1000,
+              timer_cycles_to_ns (ls->wait_max) / 1000,
+              timer_cycles_to_ns (ls->hold_total) / 1000,
+              timer_cycles_to_ns (ls->hold_max) / 1000);
+    }
+}
+
+/* Returns the statistics for LOCK acquired from SITE, creating
+   them if necessary, or a null pointer if the table is full.
+   Interrupts must be off. */
+static struct lockstat *
+lookup (const struct lock *lock, void *site) 
+{
+  size_t i = ((uintptr_t) lock * 31 + (uintptr_t) site) % LOCKSTAT_CNT;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  for (;;)
+    {
+      struct lockstat *ls = &stats[i];
+      if (ls->lock == lock && ls->site == site)
+        return ls;
+      else if (ls->lock == NULL)
+        {
+          if (used_cnt >= LOCKSTAT_CNT - 1)
+            {
+              dropped_cnt++;
+              return NULL;
+            }
+          ls->lock = lock;
+          ls->site = site;
+          used_cnt++;
+          return ls;
+        }
+      i = (i + 1) % LOCKSTAT_CNT;
+    }
+}
+
+/* qsort() comparison function that puts the lockstats with the
+   longest total wait first, and unused entries last. */
+static int
+compare_wait (const void *a_, const void *b_) 
+{
+  const struct lockstat *a = a_;
+  const struct lockstat *b = b_;
+
+  if (a->wait_total != b->wait_total)
+    return a->wait_total > b->wait_total ? -1 : 1;
+  else if (a->acquire_cnt != b->acquire_cnt)
+    return a->acquire_cnt > b->acquire_cnt ? -1 : 1;
+  else
+    return 0;
+}
+#endif /* LOCKSTAT */
@@ -0,0 +1,29 @@
+#ifndef THREADS_LOCKSTAT_H
+#define THREADS_LOCKSTAT_H
+
+/* Lock contention statistics, built in with "make LOCKSTAT=1". */
+#ifdef LOCKSTAT
+
+#include <stdbool.h>
+#include <stdint.h>
+
+struct lock;
+
+/* Statistics for one lock, acquired from one call site. */
+struct lockstat
+  {
+    const struct lock *lock;            /* Lock. */
+    void *site;                         /* Caller of lock_acquire(). */
+    unsigned long long acquire_cnt;     /* Number of acquisitions. */
+    unsigned long long contended_cnt;   /* Acquisitions that waited. */
+    int64_t wait_total, wait_max;       /* Waiting time, in cycles. */
+    int64_t hold_total, hold_max;       /* Holding time, in cycles. */
+  };
+
+void lockstat_acquired (struct lock *, void *site, int64_t start,
+                        bool contended);
+void lockstat_released (struct lock *);
+void lockstat_print_stats (void);
+
+#endif /* LOCKSTAT */
+#endif /* threads/lockstat.h */
@@ -0,0 +1,195 @@
+#include "threads/profile.h"
+#include <debug.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "devices/timer.h"
+#include "threads/interrupt.h"
+#include "threads/palloc.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#ifdef USERPROG
+#include "userprog/gdt.h"
+#endif
+
+/* Sampling profiler.
+
+   With the "-profile" option, each timer interrupt records the
+   address of the instruction that it interrupted, whether that
+   instruction was in the kernel or in a user program, and the
+   running thread's tid, in a ring buffer allocated at boot.  At
+   shutdown, the samples are sorted into a histogram of addresses
+   that is printed to the console, one line per address:
+
+        Profile kernel ADDRESS COUNT
+        Profile user TID ADDRESS COUNT
+        Profile thread TID NAME
+
+   The "pintos-prof" utility reads these lines from the kernel's
+   output and attributes the samples to functions in kernel.o and
+   in the user programs named by the "Profile thread" lines.
+
+   Ticks that the idle CPU sleeps through with "-tickless" are not
+   sampled. */
+
+/* Pages in the sample ring buffer. */
+#define PROFILE_PAGES 24
+
+/* One sample. */
+struct sample
+  {
+    uintptr_t eip;              /* Interrupted instruction. */
+    tid_t tid;                  /* Running thread. */
+    bool user;                  /* In a user program? */
+  };
+
+/* Number of samples that the ring buffer holds.  Once it is
+   full, each new sample overwrites the oldest one. */
+#define SAMPLE_CNT (PROFILE_PAGES * PGSIZE / sizeof (struct sample))
+
+/* Names of threads that were sampled in user programs, which
+   "pintos-prof" uses to find their binaries.  Further threads'
+   samples are still recorded, but cannot be symbolized. */
+#define NAME_CNT 64
+struct thread_name
+  {
+    tid_t tid;
+    char name[16];
+  };
+
+bool profile_enabled;
+
+/* Ring buffer and total number of samples taken.  Written only
+   by the timer interrupt. */
+static struct sample *samples;
+static unsigned long long sample_cnt;
+
+/* Names of sampled user threads. */
+static struct thread_name names[NAME_CNT];
+static size_t name_cnt;
+static tid_t last_user_tid = TID_ERROR;
+
+static void record_name (const struct thread *);
+static int compare_samples (const void *, const void *);
+static bool same_bucket (const struct sample *, const struct sample *);
+
+/* Allocates the sample ring buffer, if profiling is enabled. */
+void
+profile_init (void) 
+{
+  if (!profile_enabled)
+    return;
+
+  samples = palloc_get_multiple (0, PROFILE_PAGES);
+  if (samples == NULL)
+    PANIC ("profile: no memory for %d-page sample buffer", PROFILE_PAGES);
+}
+
+/* Records a sample of the instruction interrupted by the timer
+   interrupt whose frame is F.  Called in the timer interrupt
+   handler. */
+void
+profile_sample (const struct intr_frame *f) 
+{
+  struct thread *t;
+  struct sample *s;
+
+  if (samples == NULL)
+    return;
+
+  t = thread_current ();
+  s = &samples[sample_cnt++ % SAMPLE_CNT];
+  s->eip = (uintptr_t) f->eip;
+  s->tid = t->tid;
+#ifdef USERPROG
+  s->user = f->cs == SEL_UCSEG;
+#else
+  s->user = false;
+#endif
+  if (s->user && s->tid != last_user_tid)
+    record_name (t);
+}
+
+/* Stops profiling and prints the histogram of samples. */
+void
+profile_print_stats (void) 
+{
+  struct sample *buf;
+  enum intr_level old_level;
+  size_t cnt, i, j;
+
+  /* Stop sampling, so that the ring buffer can be sorted in
+     place. */
+  old_level = intr_disable ();
+  buf = samples;
+  samples = NULL;
+  intr_set_level (old_level);
+  if (buf == NULL)
+    return;
+  cnt = sample_cnt < SAMPLE_CNT ? sample_cnt : SAMPLE_CNT;
+
+  printf ("Profile: %llu samples at %d Hz (%llu overwritten)\n",
+          sample_cnt, TIMER_FREQ, sample_cnt - cnt);
+
+  for (i = 0; i < name_cnt; i++)
+    printf ("Profile thread %d %s\n", names[i].tid, names[i].name);
+
+  qsort (buf, cnt, sizeof *buf, compare_samples);
+  for (i = 0; i < cnt; i = j)
+    {
+      const struct sample *s = &buf[i];
+
+      for (j = i + 1; j < cnt && same_bucket (s, &buf[j]); j++)
+        continue;
+      if (s->user)
+        printf ("Profile user %d 0x%08"PRIxPTR" %zu\n", s->tid, s->eip, j - i);
+      else
+        printf ("Profile kernel 0x%08"PRIxPTR" %zu\n", s->eip, j - i);
+    }
+
+  palloc_free_multiple (buf, PROFILE_PAGES);
+}
+
+/* Adds T's name to the table of sampled user threads, if it is
+   not there already and there is room. */
+static void
+record_name (const struct thread *t) 
+{
+  size_t i;
+
+  last_user_tid = t->tid;
+  for (i = 0; i < name_cnt; i++)
+    if (names[i].tid == t->tid)
+      return;
+  if (name_cnt < NAME_CNT)
+    {
+      names[name_cnt].tid = t->tid;
+      strlcpy (names[name_cnt].name, t->name, sizeof names[name_cnt].name);
+      name_cnt++;
+    }
+}
+
+/* Orders samples by histogram bucket: kernel samples by address
+   alone, then user samples by thread and address. */
+static int
+compare_samples (const void *a_, const void *b_) 
+{
+  const struct sample *a = a_;
+  const struct sample *b = b_;
+
+  if (a->user != b->user)
+    return a->user ? 1 : -1;
+  if (a->user && a->tid != b->tid)
+    return a->tid < b->tid ? -1 : 1;
+  if (a->eip != b->eip)
+    return a->eip < b->eip ? -1 : 1;
+  return 0;
+}
+
+/* Returns true if A and B belong in the same histogram bucket. */
+static bool
+same_bucket (const struct sample *a, const struct sample *b) 
+{
+  return compare_samples (a, b) == 0;
+}
@@ -0,0 +1,17 @@
+#ifndef THREADS_PROFILE_H
+#define THREADS_PROFILE_H
+
+#include <stdbool.h>
+
+struct intr_frame;
+
+/* If false (default), the profiler is off.
+   If true, set by the "-profile" kernel command-line option,
+   the interrupted instruction is sampled on every timer tick. */
+extern bool profile_enabled;
+
+void profile_init (void);
+void profile_sample (const struct intr_frame *);
+void profile_print_stats (void);
+
+#endif /* threads/profile.h */
@@ -30,7 +30,10 @@
 #include <stdio.h>
 #include <string.h>
 #include "threads/interrupt.h"
+#include "threads/lockstat.h"
 #include "threads/thread.h"
+#include "threads/trace.h"
+#include "devices/timer.h"
 
 /* Initializes semaphore SEMA to VALUE.  A semaphore is a
    nonnegative integer along with two atomic operators for
@@ -75,6 +78,67 @@ sema_down (struct semaphore *sema)
   intr_set_level (old_level);
 }
 
+/* A thread waiting in sema_down_timeout(). */
+struct sema_timeout
+  {
+    struct thread *thread;      /* Waiting thread. */
+    bool timed_out;             /* Has the timeout expired? */
+  };
+
+/* Timer callback for sema_down_timeout().  If the thread is still
+   blocked on the semaphore, takes it off the wait list and wakes
+   it up. */
+static void
+sema_timeout_expired (struct timer *t UNUSED, void *st_) 
+{
+  struct sema_timeout *st = st_;
+
+  st->timed_out = true;
+  if (st->thread->status == THREAD_BLOCKED)
+    {
+      list_remove (&st->thread->elem);
+      thread_unblock (st->thread);
+    }
+}
+
+/* Like sema_down(), but gives up after TICKS timer ticks.
+   Returns true if SEMA was downed, false if the timeout expired
+   first.  A TICKS of 0 or less is equivalent to
+   sema_try_down().
+
+   This function may sleep, so it must not be called within an
+   interrupt handler. */
+bool
+sema_down_timeout (struct semaphore *sema, int64_t ticks) 
+{
+  struct sema_timeout st;
+  struct timer timer;
+  enum intr_level old_level;
+  bool success;
+
+  ASSERT (sema != NULL);
+  ASSERT (!intr_context ());
+
+  old_level = intr_disable ();
+  st.thread = thread_current ();
+  st.timed_out = ticks <= 0;
+  timer_setup (&timer, sema_timeout_expired, &st);
+  if (sema->value == 0 && !st.timed_out)
+    timer_arm (&timer, timer_ticks () + ticks);
+  while (sema->value == 0 && !st.timed_out) 
+    {
+      list_push_back (&sema->waiters, &thread_current ()->elem);
+      thread_block ();
+    }
+  timer_cancel (&timer);
+  success = sema->value > 0;
+  if (success)
+    sema->value--;
+  intr_set_level (old_level);
+
+  return success;
+}
+
 /* Down or "P" operation on a semaphore, but only if the
    semaphore is not already 0.  Returns true if the semaphore is
    decremented, false otherwise.
@@ -179,6 +243,9 @@ lock_init (struct lock *lock)
 
   lock->holder = NULL;
   sema_init (&lock->semaphore, 1);
+#ifdef LOCKSTAT
+  lock->stat = NULL;
+#endif
 }
 
 /* Acquires LOCK, sleeping until it becomes available if
@@ -192,12 +259,25 @@ lock_init (struct lock *lock)
 void
 lock_acquire (struct lock *lock)
 {
+#ifdef LOCKSTAT
+  int64_t start = timer_cycles ();
+#endif
+  bool contended;
+
   ASSERT (lock != NULL);
   ASSERT (!intr_context ());
   ASSERT (!lock_held_by_current_thread (lock));
 
+  contended = lock->semaphore.value == 0;
+  if (contended)
+    TRACE (TRACE_LOCK_WAIT, thread_current ()->tid, (uintptr_t) lock);
   sema_down (&lock->semaphore);
   lock->holder = thread_current ();
+  if (contended)
+    TRACE (TRACE_LOCK_ACQUIRE, lock->holder->tid, (uintptr_t) lock);
+#ifdef LOCKSTAT
+  lockstat_acquired (lock, __builtin_return_address (0), start, contended);
+#endif
 }
 
 /* Tries to acquires LOCK and returns true if successful or false
@@ -216,7 +296,13 @@ lock_try_acquire (struct lock *lock)
 
   success = sema_try_down (&lock->semaphore);
   if (success)
-    lock->holder = thread_current ();
+    {
+      lock->holder = thread_current ();
+#ifdef LOCKSTAT
+      lockstat_acquired (lock, __builtin_return_address (0),
+                         timer_cycles (), false);
+#endif
+    }
   return success;
 }
 
@@ -231,6 +317,9 @@ lock_release (struct lock *lock)
   ASSERT (lock != NULL);
   ASSERT (lock_held_by_current_thread (lock));
 
+#ifdef LOCKSTAT
+  lockstat_released (lock);
+#endif
   lock->holder = NULL;
   sema_up (&lock->semaphore);
 }
@@ -301,6 +390,44 @@ cond_wait (struct condition *cond, struct lock *lock)
   lock_acquire (lock);
 }
 
+/* Like cond_wait(), but gives up waiting for COND to be
+   signaled after TICKS timer ticks.  LOCK is reacquired either
+   way.  Returns true if COND was signaled, false if the timeout
+   expired first.
+
+   This function may sleep, so it must not be called within an
+   interrupt handler. */
+bool
+cond_wait_timeout (struct condition *cond, struct lock *lock,
+                   int64_t ticks) 
+{
+  struct semaphore_elem waiter;
+  bool signaled;
+
+  ASSERT (cond != NULL);
+  ASSERT (lock != NULL);
+  ASSERT (!intr_context ());
+  ASSERT (lock_held_by_current_thread (lock));
+  
+  sema_init (&waiter.semaphore, 0);
+  list_push_back (&cond->waiters, &waiter.elem);
+  lock_release (lock);
+  signaled = sema_down_timeout (&waiter.semaphore, ticks);
+  lock_acquire (lock);
+
+  /* COND may have been signaled between the timeout and
+     reacquiring LOCK.  Signals are sent with LOCK held, so now
+     either the signal is in our semaphore or we are still on
+     COND's wait list. */
+  if (!signaled)
+    {
+      signaled = sema_try_down (&waiter.semaphore);
+      if (!signaled)
+        list_remove (&waiter.elem);
+    }
+  return signaled;
+}
+
 /* If any threads are waiting on COND (protected by LOCK), then
    this function signals one of them to wake up from its wait.
    LOCK must be held before calling this function.
@@ -336,3 +463,223 @@ cond_broadcast (struct condition *cond, struct lock *lock)
   while (!list_empty (&cond->waiters))
     cond_signal (cond, lock);
 }
+
+/* Initializes RW as a reader-writer lock.  Any number of
+   readers may hold RW at once, or a single writer, but not
+   both.
+
+   The lock prefers writers: once a writer is waiting, new
+   readers wait behind it, so that a steady stream of readers
+   cannot starve writers.  When RW is released, it is handed
+   directly to the threads that get it next: the first waiting
+   writer, if any, otherwise all the waiting readers.  Waiters of
+   each kind are woken in the same order as sema_up() would wake
+   them.
+
+   Like a lock, a reader-writer lock may not be acquired
+   recursively and must be released by the thread that acquired
+   it. */
+void
+rwlock_init (struct rwlock *rw) 
+{
+  ASSERT (rw != NULL);
+
+  rw->reader_cnt = 0;
+  rw->writer = NULL;
+  list_init (&rw->read_waiters);
+  list_init (&rw->write_waiters);
+  rw->contended_cnt = 0;
+}
+
+/* Hands RW, which must be free, to the next waiting writer, or
+   to all of the waiting readers if no writer is waiting.
+   Interrupts must be off. */
+static void
+rwlock_hand_off (struct rwlock *rw) 
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (rw->writer == NULL && rw->reader_cnt == 0);
+
+  if (!list_empty (&rw->write_waiters))
+    {
+      rw->writer = list_entry (list_pop_front (&rw->write_waiters),
+                               struct thread, elem);
+      thread_unblock (rw->writer);
+    }
+  else
+    while (!list_empty (&rw->read_waiters))
+      {
+        rw->reader_cnt++;
+        thread_unblock (list_entry (list_pop_front (&rw->read_waiters),
+                                    struct thread, elem));
+      }
+}
+
+/* Acquires RW for reading, sleeping until no writer holds it or
+   is waiting for it.
+
+   This function may sleep, so it must not be called within an
+   interrupt handler. */
+void
+rwlock_acquire_read (struct rwlock *rw) 
+{
+  enum intr_level old_level;
+
+  ASSERT (rw != NULL);
+  ASSERT (!intr_context ());
+  ASSERT (rw->writer != thread_current ());
+
+  old_level = intr_disable ();
+  if (rw->writer != NULL || !list_empty (&rw->write_waiters))
+    {
+      /* rwlock_hand_off() counts us as a reader before waking us. */
+      rw->contended_cnt++;
+      list_push_back (&rw->read_waiters, &thread_current ()->elem);
+      thread_block ();
+    }
+  else
+    rw->reader_cnt++;
+  intr_set_level (old_level);
+}
+
+/* Releases RW, which the current thread holds for reading. */
+void
+rwlock_release_read (struct rwlock *rw) 
+{
+  enum intr_level old_level;
+
+  ASSERT (rw != NULL);
+
+  old_level = intr_disable ();
+  ASSERT (rw->reader_cnt > 0);
+  if (--rw->reader_cnt == 0)
+    rwlock_hand_off (rw);
+  intr_set_level (old_level);
+}
+
+/* Acquires RW for writing, sleeping until no other thread holds
+   it.
+
+   This function may sleep, so it must not be called within an
+   interrupt handler. */
+void
+rwlock_acquire_write (struct rwlock *rw) 
+{
+  enum intr_level old_level;
+
+  ASSERT (rw != NULL);
+  ASSERT (!intr_context ());
+  ASSERT (!rwlock_held_for_write (rw));
+
+  old_level = intr_disable ();
+  if (rw->writer != NULL || rw->reader_cnt > 0)
+    {
+      /* rwlock_hand_off() makes us the writer before waking us. */
+      rw->contended_cnt++;
+      list_push_back (&rw->write_waiters, &thread_current ()->elem);
+      thread_block ();
+    }
+  else
+    rw->writer = thread_current ();
+  intr_set_level (old_level);
+}
+
+/* Releases RW, which the current thread holds for writing. */
+void
+rwlock_release_write (struct rwlock *rw) 
+{
+  enum intr_level old_level;
+
+  ASSERT (rw != NULL);
+  ASSERT (rwlock_held_for_write (rw));
+
+  old_level = intr_disable ();
+  rw->writer = NULL;
+  rwlock_hand_off (rw);
+  intr_set_level (old_level);
+}
+
+/* Returns true if the current thread holds RW for writing, false
+   otherwise.  (There is no way to tell which threads hold a
+   reader-writer lock for reading.) */
+bool
+rwlock_held_for_write (const struct rwlock *rw) 
+{
+  ASSERT (rw != NULL);
+
+  return rw->writer == thread_current ();
+}
+
+/* Initializes SEQ as a sequence lock.
+
+   A sequence lock protects a small amount of data that is read
+   much more often than it is written, such as a counter that is
+   too wide to read atomically.  Readers never block or disable
+   interrupts.  Instead they read the data between
+   seqlock_read_begin() and seqlock_read_retry(), and try again if
+   a write happened in the meantime:
+
+        do
+          {
+            start = seqlock_read_begin (&seq);
+            copy = data;
+          }
+        while (seqlock_read_retry (&seq, start));
+
+   Writers must not be interrupted by readers, so a write has to
+   happen in an interrupt handler or with interrupts off.  Because
+   readers may see the data half-written, they must not follow
+   pointers read this way before checking the sequence. */
+void
+seqlock_init (struct seqlock *seq) 
+{
+  ASSERT (seq != NULL);
+
+  seq->seq = 0;
+}
+
+/* Begins a read of the data protected by SEQ.  Returns a value
+   to pass to seqlock_read_retry(). */
+unsigned
+seqlock_read_begin (const struct seqlock *seq) 
+{
+  unsigned start;
+
+  while ((start = *(volatile const unsigned *) &seq->seq) & 1)
+    barrier ();
+  barrier ();
+  return start;
+}
+
+/* Returns true if the data protected by SEQ may have changed
+   since the seqlock_read_begin() call that returned START, in
+   which case the caller must read it again. */
+bool
+seqlock_read_retry (const struct seqlock *seq, unsigned start) 
+{
+  barrier ();
+  return *(volatile const unsigned *) &seq->seq != start;
+}
+
+/* Begins a write of the data protected by SEQ.  Interrupts must
+   be off. */
+void
+seqlock_write_begin (struct seqlock *seq) 
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT ((seq->seq & 1) == 0);
+
+  seq->seq++;
+  barrier ();
+}
+
+/* Ends a write of the data protected by SEQ. */
+void
+seqlock_write_end (struct seqlock *seq) 
+{
+  ASSERT ((seq->seq & 1) != 0);
+
+  barrier ();
+  seq->seq++;
+}
+
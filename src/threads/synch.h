@@ -3,6 +3,7 @@
 
 #include <list.h>
 #include <stdbool.h>
+#include <stdint.h>
 
 /* A counting semaphore. */
 struct semaphore 
@@ -13,6 +14,7 @@ struct semaphore
 
 void sema_init (struct semaphore *, unsigned value);
 void sema_down (struct semaphore *);
+bool sema_down_timeout (struct semaphore *, int64_t ticks);
 bool sema_try_down (struct semaphore *);
 void sema_up (struct semaphore *);
 void sema_self_test (void);
@@ -22,6 +24,10 @@ struct lock
   {
     struct thread *holder;      /* Thread holding lock (for debugging). */
     struct semaphore semaphore; /* Binary semaphore controlling access. */
+#ifdef LOCKSTAT
+    struct lockstat *stat;      /* Statistics for current holder's site. */
+    int64_t acquired;           /* When the holder acquired the lock. */
+#endif
   };
 
 void lock_init (struct lock *);
@@ -38,9 +44,39 @@ struct condition
 
 void cond_init (struct condition *);
 void cond_wait (struct condition *, struct lock *);
+bool cond_wait_timeout (struct condition *, struct lock *, int64_t ticks);
 void cond_signal (struct condition *, struct lock *);
 void cond_broadcast (struct condition *, struct lock *);
 
+/* Reader-writer lock. */
+struct rwlock 
+  {
+    int reader_cnt;             /* Number of readers holding lock. */
+    struct thread *writer;      /* Writer holding lock, or null. */
+    struct list read_waiters;   /* Threads waiting to read. */
+    struct list write_waiters;  /* Threads waiting to write. */
+    unsigned long long contended_cnt; /* Acquisitions that had to wait. */
+  };
+
+void rwlock_init (struct rwlock *);
+void rwlock_acquire_read (struct rwlock *);
+void rwlock_release_read (struct rwlock *);
+void rwlock_acquire_write (struct rwlock *);
+void rwlock_release_write (struct rwlock *);
+bool rwlock_held_for_write (const struct rwlock *);
+
+/* Sequence lock. */
+struct seqlock 
+  {
+    unsigned seq;               /* Odd while a write is in progress. */
+  };
+
+void seqlock_init (struct seqlock *);
+unsigned seqlock_read_begin (const struct seqlock *);
+bool seqlock_read_retry (const struct seqlock *, unsigned start);
+void seqlock_write_begin (struct seqlock *);
+void seqlock_write_end (struct seqlock *);
+
 /* Optimization barrier.
 
    The compiler will not reorder operations across an
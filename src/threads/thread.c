@@ -5,12 +5,15 @@
 #include <stdio.h>
 #include <string.h>
 #include "threads/flags.h"
+#include "threads/fpu.h"
 #include "threads/interrupt.h"
 #include "threads/intr-stubs.h"
 #include "threads/palloc.h"
 #include "threads/switch.h"
 #include "threads/synch.h"
+#include "threads/trace.h"
 #include "threads/vaddr.h"
+#include "devices/timer.h"
 #ifdef USERPROG
 #include "userprog/process.h"
 #endif
@@ -24,6 +27,11 @@
    that are ready to run but not actually running. */
 static struct list ready_list;
 
+/* With "-cfs", the same processes, ordered by virtual runtime,
+   and their total weight. */
+static struct rb_tree ready_tree;
+static long ready_weight;
+
 /* List of all processes.  Processes are added to this list
    when they are first scheduled and removed when they exit. */
 static struct list all_list;
@@ -47,23 +55,80 @@ struct kernel_thread_frame
 
 /* Statistics. */
 static long long idle_ticks;    /* # of timer ticks spent idle. */
+static long long skipped_ticks; /* # of idle ticks with timer stopped. */
 static long long kernel_ticks;  /* # of timer ticks in kernel threads. */
 static long long user_ticks;    /* # of timer ticks in user programs. */
+static long long block_io_ticks; /* # of kernel ticks in block drivers. */
 
 /* Scheduling. */
 #define TIME_SLICE 4            /* # of timer ticks to give each thread. */
 static unsigned thread_ticks;   /* # of timer ticks since last yield. */
+static int64_t min_vruntime;    /* With "-cfs", floor for vruntimes. */
+static int64_t exec_start;      /* With "-cfs", when the running
+                                   thread's vruntime was last
+                                   updated, in ns. */
+
+/* Completely fair scheduler.
+
+   With "-cfs", the run queue is a red-black tree of ready
+   threads ordered by virtual runtime, the time that a thread has
+   spent running, in nanoseconds, scaled down by the weight that
+   its nice value maps to.  The thread with the least virtual
+   runtime runs next, so over time each runnable thread gets a
+   share of the CPU in proportion to its weight.
+
+   A thread runs for its weight's share of CFS_LATENCY, but at
+   least one timer tick, before it is preempted.  A thread that
+   wakes up from sleeping has its virtual runtime raised to no
+   less than the minimum virtual runtime minus
+   CFS_SLEEPER_CREDIT, so that it runs soon but cannot bank
+   credit for all the time it slept.  If that leaves it behind the
+   running thread by more than CFS_WAKEUP_GRANULARITY, it
+   preempts it. */
+#define NS_PER_TICK (1000000000LL / TIMER_FREQ)
+#define CFS_LATENCY (8 * NS_PER_TICK)
+#define CFS_SLEEPER_CREDIT (CFS_LATENCY / 2)
+#define CFS_WAKEUP_GRANULARITY NS_PER_TICK
+
+/* Weight of each nice value, from NICE_MIN to NICE_MAX.  Each
+   step in niceness changes a thread's share of the CPU relative
+   to another's by about 25%. */
+#define NICE_0_WEIGHT 1024
+static const int nice_weights[NICE_MAX - NICE_MIN + 1] = 
+  {
+    /* -20 */ 88761, 71755, 56483, 46273, 36291,
+    /* -15 */ 29154, 23254, 18705, 14949, 11916,
+    /* -10 */  9548,  7620,  6100,  4904,  3906,
+    /*  -5 */  3121,  2501,  1991,  1586,  1277,
+    /*   0 */  1024,   820,   655,   526,   423,
+    /*   5 */   335,   272,   215,   172,   137,
+    /*  10 */   110,    87,    70,    56,    45,
+    /*  15 */    36,    29,    23,    18,    15,
+    /*  20 */    12,
+  };
 
 /* If false (default), use round-robin scheduler.
    If true, use multi-level feedback queue scheduler.
    Controlled by kernel command-line option "-o mlfqs". */
 bool thread_mlfqs;
 
+/* If false (default), use the scheduler selected by thread_mlfqs.
+   If true, use the completely fair scheduler.
+   Controlled by kernel command-line option "-cfs". */
+bool thread_cfs;
+
 static void kernel_thread (thread_func *, void *aux);
 
 static void idle (void *aux UNUSED);
 static struct thread *running_thread (void);
 static struct thread *next_thread_to_run (void);
+static void push_ready (struct thread *);
+static struct thread *pop_ready (void);
+static bool vruntime_less (const struct rb_elem *, const struct rb_elem *,
+                           void *aux);
+static int thread_weight (const struct thread *);
+static unsigned time_slice (const struct thread *);
+static void update_vruntime (struct thread *);
 static void init_thread (struct thread *, const char *name, int priority);
 static bool is_thread (struct thread *) UNUSED;
 static void *alloc_frame (struct thread *, size_t size);
@@ -91,6 +156,7 @@ thread_init (void)
 
   lock_init (&tid_lock);
   list_init (&ready_list);
+  rb_init (&ready_tree, vruntime_less, NULL);
   list_init (&all_list);
 
   /* Set up a thread structure for the running thread. */
@@ -98,6 +164,7 @@ thread_init (void)
   init_thread (initial_thread, "main", PRI_DEFAULT);
   initial_thread->status = THREAD_RUNNING;
   initial_thread->tid = allocate_tid ();
+  trace_thread_name (initial_thread->tid, initial_thread->name);
 }
 
 /* Starts preemptive thread scheduling by enabling interrupts.
@@ -132,19 +199,39 @@ thread_tick (void)
     user_ticks++;
 #endif
   else
-    kernel_ticks++;
+    {
+      kernel_ticks++;
+      if (t->in_block_io)
+        block_io_ticks++;
+    }
 
   /* Enforce preemption. */
-  if (++thread_ticks >= TIME_SLICE)
+  if (thread_cfs)
+    update_vruntime (t);
+  if (++thread_ticks >= time_slice (t))
     intr_yield_on_return ();
 }
 
+/* Accounts for CNT timer ticks that the idle thread slept
+   through with the periodic timer stopped.  Called by the timer
+   interrupt code in an external interrupt context. */
+void
+thread_skip_ticks (int cnt) 
+{
+  ASSERT (thread_current () == idle_thread);
+
+  idle_ticks += cnt;
+  skipped_ticks += cnt;
+}
+
 /* Prints thread statistics. */
 void
 thread_print_stats (void) 
 {
-  printf ("Thread: %lld idle ticks, %lld kernel ticks, %lld user ticks\n",
-          idle_ticks, kernel_ticks, user_ticks);
+  printf ("Thread: %lld idle ticks (%lld suppressed), %lld kernel ticks "
+          "(%lld in block I/O), %lld user ticks\n",
+          idle_ticks, skipped_ticks, kernel_ticks, block_io_ticks,
+          user_ticks);
 }
 
 /* Creates a new kernel thread named NAME with the given initial
@@ -182,6 +269,9 @@ thread_create (const char *name, int priority,
   /* Initialize thread. */
   init_thread (t, name, priority);
   tid = t->tid = allocate_tid ();
+  trace_thread_name (tid, t->name);
+  t->nice = thread_current ()->nice;
+  t->vruntime = min_vruntime;
 
   /* Stack frame for kernel_thread(). */
   kf = alloc_frame (t, sizeof *kf);
@@ -216,6 +306,9 @@ thread_block (void)
   ASSERT (!intr_context ());
   ASSERT (intr_get_level () == INTR_OFF);
 
+  TRACE (TRACE_BLOCK, thread_current ()->tid, 0);
+  if (thread_cfs)
+    update_vruntime (thread_current ());
   thread_current ()->status = THREAD_BLOCKED;
   schedule ();
 }
@@ -227,7 +320,9 @@ thread_block (void)
    This function does not preempt the running thread.  This can
    be important: if the caller had disabled interrupts itself,
    it may expect that it can atomically unblock a thread and
-   update other data. */
+   update other data.  (With "-cfs", when called from an
+   interrupt handler, it may make the running thread yield when
+   the handler returns.) */
 void
 thread_unblock (struct thread *t) 
 {
@@ -237,11 +332,59 @@ thread_unblock (struct thread *t)
 
   old_level = intr_disable ();
   ASSERT (t->status == THREAD_BLOCKED);
-  list_push_back (&ready_list, &t->elem);
+  TRACE (TRACE_UNBLOCK, running_thread ()->tid, t->tid);
+  if (thread_cfs) 
+    {
+      struct thread *cur = running_thread ();
+
+      /* Give a sleeper limited credit for the time it slept. */
+      if (t->vruntime < min_vruntime - CFS_SLEEPER_CREDIT)
+        t->vruntime = min_vruntime - CFS_SLEEPER_CREDIT;
+      if (intr_context ()
+          && (cur == idle_thread
+              || t->vruntime + CFS_WAKEUP_GRANULARITY < cur->vruntime))
+        intr_yield_on_return ();
+    }
+  push_ready (t);
   t->status = THREAD_READY;
   intr_set_level (old_level);
 }
 
+/* Like thread_unblock(), but puts T ahead of every other ready
+   thread and, when called from an interrupt handler, makes the
+   running thread yield to T when the handler returns.  Meant for
+   kernel threads that finish work on behalf of interrupt
+   handlers, which should not wait a time slice for each ready
+   thread.
+
+   With "-cfs", this is the same as thread_unblock().  A thread
+   that mostly sleeps wakes up with the bounded sleeper credit at
+   the front of the tree anyway, and preempts the running thread
+   by the usual wakeup check.  Letting it jump further ahead would
+   take CPU time from the other threads without limit. */
+void
+thread_unblock_urgent (struct thread *t) 
+{
+  enum intr_level old_level;
+
+  ASSERT (is_thread (t));
+
+  if (thread_cfs) 
+    {
+      thread_unblock (t);
+      return;
+    }
+
+  old_level = intr_disable ();
+  ASSERT (t->status == THREAD_BLOCKED);
+  TRACE (TRACE_UNBLOCK, running_thread ()->tid, t->tid);
+  list_push_front (&ready_list, &t->elem);
+  t->status = THREAD_READY;
+  if (intr_context ())
+    intr_yield_on_return ();
+  intr_set_level (old_level);
+}
+
 /* Returns the name of the running thread. */
 const char *
 thread_name (void) 
@@ -285,6 +428,7 @@ thread_exit (void)
 #ifdef USERPROG
   process_exit ();
 #endif
+  fpu_exit ();
 
   /* Remove thread from all threads list, set our status to dying,
      and schedule another process.  That process will destroy us
@@ -308,7 +452,11 @@ thread_yield (void)
 
   old_level = intr_disable ();
   if (cur != idle_thread) 
-    list_push_back (&ready_list, &cur->elem);
+    {
+      if (thread_cfs)
+        update_vruntime (cur);
+      push_ready (cur);
+    }
   cur->status = THREAD_READY;
   schedule ();
   intr_set_level (old_level);
@@ -347,17 +495,29 @@ thread_get_priority (void)
 
 /* Sets the current thread's nice value to NICE. */
 void
-thread_set_nice (int nice UNUSED) 
+thread_set_nice (int nice) 
 {
-  /* Not yet implemented. */
+  ASSERT (NICE_MIN <= nice && nice <= NICE_MAX);
+
+  thread_current ()->nice = nice;
 }
 
 /* Returns the current thread's nice value. */
 int
 thread_get_nice (void) 
 {
-  /* Not yet implemented. */
-  return 0;
+  return thread_current ()->nice;
+}
+
+/* Returns the weight that the completely fair scheduler gives a
+   thread with the given NICE value.  A thread's share of the CPU
+   is its weight divided by the total weight of runnable threads. */
+int
+thread_nice_weight (int nice) 
+{
+  ASSERT (NICE_MIN <= nice && nice <= NICE_MAX);
+
+  return nice_weights[nice - NICE_MIN];
 }
 
 /* Returns 100 times the system load average. */
@@ -398,6 +558,10 @@ idle (void *idle_started_ UNUSED)
       intr_disable ();
       thread_block ();
 
+      /* Nothing else is ready to run, so the periodic timer tick
+         can be stopped until the next sleeper is due. */
+      timer_idle_enter ();
+
       /* Re-enable interrupts and wait for the next one.
 
          The `sti' instruction disables interrupts until the
@@ -490,10 +654,115 @@ alloc_frame (struct thread *t, size_t size)
 static struct thread *
 next_thread_to_run (void) 
 {
-  if (list_empty (&ready_list))
-    return idle_thread;
+  struct thread *t = pop_ready ();
+
+  return t != NULL ? t : idle_thread;
+}
+
+/* Adds T to the run queue. */
+static void
+push_ready (struct thread *t) 
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (thread_cfs) 
+    {
+      rb_insert (&ready_tree, &t->rb_elem);
+      ready_weight += thread_weight (t);
+    }
   else
-    return list_entry (list_pop_front (&ready_list), struct thread, elem);
+    list_push_back (&ready_list, &t->elem);
+}
+
+/* Removes and returns a thread from the run queue, or returns a
+   null pointer if it is empty.  Takes the thread at the front,
+   which has waited longest, or with "-cfs", the thread with the
+   least virtual runtime. */
+static struct thread *
+pop_ready (void) 
+{
+  struct thread *t = NULL;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (thread_cfs) 
+    {
+      struct rb_elem *e = rb_min (&ready_tree);
+      if (e != NULL) 
+        {
+          t = rb_entry (e, struct thread, rb_elem);
+          rb_remove (&ready_tree, e);
+          ready_weight -= thread_weight (t);
+          if (t->vruntime > min_vruntime)
+            min_vruntime = t->vruntime;
+        }
+    }
+  else if (!list_empty (&ready_list))
+    t = list_entry (list_pop_front (&ready_list), struct thread, elem);
+  return t;
+}
+
+/* Orders threads by virtual runtime. */
+static bool
+vruntime_less (const struct rb_elem *a_, const struct rb_elem *b_,
+               void *aux UNUSED) 
+{
+  const struct thread *a = rb_entry (a_, struct thread, rb_elem);
+  const struct thread *b = rb_entry (b_, struct thread, rb_elem);
+
+  return a->vruntime < b->vruntime;
+}
+
+/* Returns T's scheduling weight. */
+static int
+thread_weight (const struct thread *t) 
+{
+  return thread_nice_weight (t->nice);
+}
+
+/* Returns the number of timer ticks that T may run before it is
+   preempted. */
+static unsigned
+time_slice (const struct thread *t) 
+{
+  int64_t weight, slice;
+
+  if (!thread_cfs || t == idle_thread)
+    return TIME_SLICE;
+
+  weight = thread_weight (t);
+  slice = CFS_LATENCY * weight / (weight + ready_weight) / NS_PER_TICK;
+  return slice > 1 ? slice : 1;
+}
+
+/* Charges T, the running thread, for the time it has run since
+   it was last charged, and advances the minimum virtual
+   runtime.  Interrupts must be off.  T must not be in the run
+   queue, because its position there depends on its virtual
+   runtime. */
+static void
+update_vruntime (struct thread *t) 
+{
+  int64_t now = timer_ns ();
+  struct rb_elem *min;
+  int64_t floor;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (t != idle_thread && now > exec_start)
+    t->vruntime += (now - exec_start) * NICE_0_WEIGHT / thread_weight (t);
+  exec_start = now;
+
+  /* The minimum never goes backward, so that a thread that
+     sleeps and wakes cannot gain by it. */
+  if (t == idle_thread)
+    return;
+  floor = t->vruntime;
+  min = rb_min (&ready_tree);
+  if (min != NULL && rb_entry (min, struct thread, rb_elem)->vruntime < floor)
+    floor = rb_entry (min, struct thread, rb_elem)->vruntime;
+  if (floor > min_vruntime)
+    min_vruntime = floor;
 }
 
 /* Completes a thread switch by activating the new thread's page
@@ -524,6 +793,11 @@ thread_schedule_tail (struct thread *prev)
 
   /* Start new time slice. */
   thread_ticks = 0;
+  if (thread_cfs)
+    exec_start = timer_ns ();
+
+  /* Make the FPU trap unless it holds our state. */
+  fpu_switch (cur);
 
 #ifdef USERPROG
   /* Activate the new address space. */
@@ -561,7 +835,10 @@ schedule (void)
   ASSERT (is_thread (next));
 
   if (cur != next)
-    prev = switch_threads (cur, next);
+    {
+      TRACE (TRACE_SWITCH, cur->tid, next->tid);
+      prev = switch_threads (cur, next);
+    }
   thread_schedule_tail (prev);
 }
 
@@ -3,6 +3,7 @@
 
 #include <debug.h>
 #include <list.h>
+#include <rbtree.h>
 #include <stdint.h>
 
 /* States in a thread's life cycle. */
@@ -24,6 +25,11 @@ typedef int tid_t;
 #define PRI_DEFAULT 31                  /* Default priority. */
 #define PRI_MAX 63                      /* Highest priority. */
 
+/* Thread niceness. */
+#define NICE_MIN -20                    /* Greediest. */
+#define NICE_DEFAULT 0                  /* Default niceness. */
+#define NICE_MAX 20                     /* Nicest. */
+
 /* A kernel thread or user process.
 
    Each thread structure is stored in its own 4 kB page.  The
@@ -89,6 +95,9 @@ struct thread
     uint8_t *stack;                     /* Saved stack pointer. */
     int priority;                       /* Priority. */
     struct list_elem allelem;           /* List element for all threads list. */
+    int nice;                           /* Niceness. */
+    int64_t vruntime;                   /* CFS: weighted run time, in ns. */
+    struct rb_elem rb_elem;             /* CFS: run queue element. */
 
     /* Shared between thread.c and synch.c. */
     struct list_elem elem;              /* List element. */
@@ -98,6 +107,17 @@ struct thread
     uint32_t *pagedir;                  /* Page directory. */
 #endif
 
+    /* Owned by threads/fpu.c. */
+    void *fpu;                          /* FPU save area, if FPU used. */
+
+    /* Owned by devices/block.c. */
+    bool in_block_io;                   /* In a block device driver? */
+
+#ifdef FILESYS
+    /* Owned by filesys/journal.c. */
+    int journal_depth;                  /* Nesting of transaction handles. */
+#endif
+
     /* Owned by thread.c. */
     unsigned magic;                     /* Detects stack overflow. */
   };
@@ -107,10 +127,16 @@ struct thread
    Controlled by kernel command-line option "-o mlfqs". */
 extern bool thread_mlfqs;
 
+/* If false (default), use the scheduler selected by thread_mlfqs.
+   If true, use the completely fair scheduler.
+   Controlled by kernel command-line option "-cfs". */
+extern bool thread_cfs;
+
 void thread_init (void);
 void thread_start (void);
 
 void thread_tick (void);
+void thread_skip_ticks (int cnt);
 void thread_print_stats (void);
 
 typedef void thread_func (void *aux);
@@ -118,6 +144,7 @@ tid_t thread_create (const char *name, int priority, thread_func *, void *);
 
 void thread_block (void);
 void thread_unblock (struct thread *);
+void thread_unblock_urgent (struct thread *);
 
 struct thread *thread_current (void);
 tid_t thread_tid (void);
@@ -135,6 +162,7 @@ void thread_set_priority (int);
 
 int thread_get_nice (void);
 void thread_set_nice (int);
+int thread_nice_weight (int nice);
 int thread_get_recent_cpu (void);
 int thread_get_load_avg (void);
 
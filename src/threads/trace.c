@@ -0,0 +1,245 @@
+#include "threads/trace.h"
+#include <debug.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/timer.h"
+#include "threads/interrupt.h"
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+
+/* Scheduler event tracing.
+
+   With the "-trace" option, thread switches, blocking and
+   unblocking, lock waits, and interrupt entry and exit are logged
+   with timer_cycles() timestamps in a ring buffer allocated at
+   boot.  At shutdown, the events are dumped to the console in a
+   compact binary format, written out in hexadecimal as lines that
+   begin with "TRACE ".  "pintos-trace2json" converts them to the
+   Chrome trace format for viewing as a timeline.
+
+   The dump is a header followed by a table of thread names and
+   then the events, oldest first.  All fields are little-endian:
+
+        Header (16 bytes):
+          char magic[4]         "PTRC"
+          uint16_t version      TRACE_VERSION
+          uint16_t name_cnt     Number of thread names
+          uint32_t event_cnt    Number of events
+          uint32_t lost_cnt     Events overwritten in the ring
+
+        Thread name (18 bytes):
+          uint16_t tid
+          char name[16]         Null-padded
+
+        Event (12 bytes):
+          uint32_t delta        Nanoseconds since the previous event,
+                                saturating at UINT32_MAX
+          uint8_t type          enum trace_type
+          uint8_t reserved      0
+          uint16_t tid          Thread that logged the event
+          uint32_t arg          Event-specific argument
+
+   Tids are truncated to 16 bits. */
+
+/* Dump format version. */
+#define TRACE_VERSION 1
+
+/* Pages in the event ring buffer. */
+#define TRACE_PAGES 32
+
+/* One logged event. */
+struct event
+  {
+    int64_t time;               /* timer_cycles() value. */
+    uint32_t arg;               /* Event-specific argument. */
+    uint16_t tid;               /* Thread. */
+    uint8_t type;               /* enum trace_type. */
+  };
+
+/* Number of events that the ring buffer holds.  Once it is full,
+   each new event overwrites the oldest one. */
+#define EVENT_CNT (TRACE_PAGES * PGSIZE / sizeof (struct event))
+
+/* Number of thread names that can be recorded. */
+#define NAME_CNT 256
+struct thread_name
+  {
+    uint16_t tid;
+    char name[16];
+  };
+
+bool trace_enabled;
+
+/* Ring buffer and total number of events logged.  Protected by
+   disabling interrupts. */
+static struct event *events;
+static unsigned long long event_cnt;
+
+/* Names of threads created while tracing, null-padded. */
+static struct thread_name names[NAME_CNT];
+static size_t name_cnt;
+
+static void put_bytes (const void *, size_t);
+static void put_u16 (uint16_t);
+static void put_u32 (uint32_t);
+static void flush_bytes (void);
+
+/* Allocates the event ring buffer, if tracing is enabled.
+   Events logged before this are discarded. */
+void
+trace_init (void) 
+{
+  if (!trace_enabled)
+    return;
+
+  events = palloc_get_multiple (0, TRACE_PAGES);
+  if (events == NULL)
+    PANIC ("trace: no memory for %d-page event buffer", TRACE_PAGES);
+}
+
+/* Logs an event of the given TYPE by thread TID, with
+   event-specific argument ARG.  Use the TRACE macro instead of
+   calling this directly. */
+void
+trace_record (enum trace_type type, tid_t tid, uint32_t arg) 
+{
+  enum intr_level old_level;
+  struct event *e;
+
+  if (events == NULL)
+    return;
+
+  old_level = intr_disable ();
+  e = &events[event_cnt++ % EVENT_CNT];
+  e->time = timer_cycles ();
+  e->arg = arg;
+  e->tid = tid;
+  e->type = type;
+  intr_set_level (old_level);
+}
+
+/* Records that thread TID is named NAME.  Threads are named
+   before the event buffer is allocated, so that the initial
+   thread's name is not lost. */
+void
+trace_thread_name (tid_t tid, const char *name) 
+{
+  enum intr_level old_level;
+
+  if (!trace_enabled)
+    return;
+
+  old_level = intr_disable ();
+  if (name_cnt < NAME_CNT)
+    {
+      names[name_cnt].tid = tid;
+      strlcpy (names[name_cnt].name, name, sizeof names[name_cnt].name);
+      name_cnt++;
+    }
+  intr_set_level (old_level);
+}
+
+/* Stops tracing and dumps the logged events to the console. */
+void
+trace_dump (void) 
+{
+  struct event *buf;
+  enum intr_level old_level;
+  unsigned long long first, i;
+  int64_t prev_ns;
+  size_t cnt;
+
+  old_level = intr_disable ();
+  buf = events;
+  events = NULL;
+  intr_set_level (old_level);
+  if (buf == NULL)
+    return;
+
+  cnt = event_cnt < EVENT_CNT ? event_cnt : EVENT_CNT;
+  first = event_cnt - cnt;
+  printf ("Trace: %zu events (%llu overwritten), %zu thread names\n",
+          cnt, first, name_cnt);
+
+  put_bytes ("PTRC", 4);
+  put_u16 (TRACE_VERSION);
+  put_u16 (name_cnt);
+  put_u32 (cnt);
+  put_u32 (first < UINT32_MAX ? first : UINT32_MAX);
+
+  for (i = 0; i < name_cnt; i++) 
+    {
+      put_u16 (names[i].tid);
+      put_bytes (names[i].name, sizeof names[i].name);
+    }
+
+  prev_ns = cnt > 0 ? timer_cycles_to_ns (buf[first % EVENT_CNT].time) : 0;
+  for (i = first; i < event_cnt; i++) 
+    {
+      const struct event *e = &buf[i % EVENT_CNT];
+      int64_t ns = timer_cycles_to_ns (e->time);
+      int64_t delta = ns - prev_ns;
+      uint8_t type_reserved[2];
+
+      prev_ns = ns;
+      put_u32 (delta < 0 ? 0 : delta < UINT32_MAX ? delta : UINT32_MAX);
+      type_reserved[0] = e->type;
+      type_reserved[1] = 0;
+      put_bytes (type_reserved, 2);
+      put_u16 (e->tid);
+      put_u32 (e->arg);
+    }
+  flush_bytes ();
+
+  palloc_free_multiple (buf, TRACE_PAGES);
+}
+
+/* Bytes of the dump not yet printed. */
+#define LINE_BYTES 32
+static uint8_t line[LINE_BYTES];
+static size_t line_len;
+
+/* Adds the SIZE bytes at DATA to the dump. */
+static void
+put_bytes (const void *data_, size_t size) 
+{
+  const uint8_t *data = data_;
+
+  while (size-- > 0)
+    {
+      line[line_len++] = *data++;
+      if (line_len == LINE_BYTES)
+        flush_bytes ();
+    }
+}
+
+/* Adds X to the dump as 2 little-endian bytes. */
+static void
+put_u16 (uint16_t x) 
+{
+  uint8_t b[2] = { x, x >> 8 };
+  put_bytes (b, sizeof b);
+}
+
+/* Adds X to the dump as 4 little-endian bytes. */
+static void
+put_u32 (uint32_t x) 
+{
+  uint8_t b[4] = { x, x >> 8, x >> 16, x >> 24 };
+  put_bytes (b, sizeof b);
+}
+
+/* Prints the bytes of the dump not yet printed as one line. */
+static void
+flush_bytes (void) 
+{
+  char hex[LINE_BYTES * 2 + 1];
+  size_t i;
+
+  if (line_len == 0)
+    return;
+  for (i = 0; i < line_len; i++)
+    snprintf (hex + i * 2, 3, "%02x", line[i]);
+  printf ("TRACE %s\n", hex);
+  line_len = 0;
+}
@@ -0,0 +1,42 @@
+#ifndef THREADS_TRACE_H
+#define THREADS_TRACE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "threads/thread.h"
+
+/* Scheduler event types.  The values are part of the dump
+   format read by "pintos-trace2json", so only add to the end. */
+enum trace_type
+  {
+    TRACE_SWITCH,               /* Switch to thread ARG. */
+    TRACE_BLOCK,                /* Thread blocks. */
+    TRACE_UNBLOCK,              /* Thread ARG is unblocked. */
+    TRACE_LOCK_WAIT,            /* Thread starts waiting for lock ARG. */
+    TRACE_LOCK_ACQUIRE,         /* Thread acquires lock ARG after waiting. */
+    TRACE_INTR_ENTER,           /* Interrupt ARG begins. */
+    TRACE_INTR_EXIT             /* Interrupt ARG ends. */
+  };
+
+/* If false (default), no events are traced.
+   If true, set by the "-trace" kernel command-line option,
+   scheduler events are logged and dumped at shutdown. */
+extern bool trace_enabled;
+
+/* Logs an event of the given TYPE by the thread with the given
+   TID, with event-specific argument ARG.  The arguments are not
+   evaluated unless tracing is enabled. */
+#define TRACE(TYPE, TID, ARG)                                   \
+        do                                                      \
+          {                                                     \
+            if (trace_enabled)                                  \
+              trace_record (TYPE, TID, ARG);                    \
+          }                                                     \
+        while (0)
+
+void trace_init (void);
+void trace_record (enum trace_type, tid_t, uint32_t arg);
+void trace_thread_name (tid_t, const char *name);
+void trace_dump (void);
+
+#endif /* threads/trace.h */
@@ -0,0 +1,192 @@
+#include "threads/workqueue.h"
+#include <debug.h>
+#include <stdio.h>
+#include "threads/interrupt.h"
+#include "threads/thread.h"
+
+/* Deferred work.
+
+   Interrupt handlers run with interrupts off and may not sleep,
+   so any work they do holds up every other interrupt.  A handler
+   that has more to do than acknowledging its device can queue a
+   work item instead, and one of the worker threads below will
+   call the item's function in thread context, with interrupts
+   on.  Work items of equal priority run in the order they were
+   queued.
+
+   Thread priorities are not enforced by the scheduler, so a
+   worker that merely became ready could wait behind every other
+   ready thread.  Instead, queuing work wakes the worker with
+   thread_unblock_urgent(), which runs it as soon as the
+   interrupt handler returns (with "-cfs", as soon as its
+   virtual runtime allows).
+
+   Handlers whose work is short and bounded stay as they are.
+   timer_interrupt() must run its timers on their exact tick, and
+   serial_interrupt() moves at most one FIFO's worth of bytes and
+   needs to refill the FIFO promptly to keep output flowing. */
+
+/* A workqueue: a list of work items and a thread that runs them. */
+struct workqueue
+  {
+    const char *name;           /* Worker thread name. */
+    int priority;               /* Worker thread priority. */
+    struct list items;          /* Queued work items. */
+    struct thread *thread;      /* Worker thread. */
+    bool waiting;               /* Worker blocked waiting for items? */
+    long long run_cnt;          /* Number of items run. */
+    int depth;                  /* Number of items queued now. */
+    int max_depth;              /* Most items ever queued at once. */
+  };
+
+/* One workqueue per priority.  The lists and counters are
+   protected by disabling interrupts. */
+static struct workqueue workqueues[WORK_PRI_CNT];
+
+static bool initialized;
+
+static void init_workqueue (enum work_priority, const char *name,
+                            int priority);
+static thread_func worker;
+
+/* Initializes the workqueues and starts their worker threads.
+   Must be called after thread_start(). */
+void
+workqueue_init (void) 
+{
+  struct workqueue *wq;
+
+  init_workqueue (WORK_HIGH, "work-high", PRI_MAX);
+  initialized = true;
+
+  for (wq = workqueues; wq < workqueues + WORK_PRI_CNT; wq++)
+    if (thread_create (wq->name, wq->priority, worker, wq) == TID_ERROR)
+      PANIC ("couldn't start worker thread %s", wq->name);
+}
+
+/* Initializes W to call FUNC, passing W and AUX, when it is
+   run. */
+void
+work_init (struct work *w, work_func *func, void *aux) 
+{
+  ASSERT (w != NULL);
+  ASSERT (func != NULL);
+
+  w->func = func;
+  w->aux = aux;
+  w->queued = false;
+}
+
+/* Queues W to be run by the worker thread for PRIORITY.  Returns
+   true if W was queued, false if it was already queued, in which
+   case it will still run only once.  May be called from an
+   interrupt handler. */
+bool
+work_queue (struct work *w, enum work_priority priority) 
+{
+  struct workqueue *wq;
+  enum intr_level old_level;
+  bool queued = false;
+
+  ASSERT (w != NULL && w->func != NULL);
+  ASSERT (priority < WORK_PRI_CNT);
+  ASSERT (initialized);
+
+  wq = &workqueues[priority];
+  old_level = intr_disable ();
+  if (!w->queued)
+    {
+      list_push_back (&wq->items, &w->elem);
+      w->queued = queued = true;
+      w->priority = priority;
+      if (++wq->depth > wq->max_depth)
+        wq->max_depth = wq->depth;
+      if (wq->waiting) 
+        {
+          wq->waiting = false;
+          thread_unblock_urgent (wq->thread);
+        }
+    }
+  intr_set_level (old_level);
+
+  return queued;
+}
+
+/* Removes W from its workqueue.  Returns true if W was queued,
+   false if it was not queued or had already started running. */
+bool
+work_cancel (struct work *w) 
+{
+  enum intr_level old_level;
+  bool was_queued;
+
+  ASSERT (w != NULL);
+
+  old_level = intr_disable ();
+  was_queued = w->queued;
+  if (was_queued)
+    {
+      list_remove (&w->elem);
+      w->queued = false;
+      workqueues[w->priority].depth--;
+    }
+  intr_set_level (old_level);
+
+  return was_queued;
+}
+
+/* Prints workqueue statistics. */
+void
+workqueue_print_stats (void) 
+{
+  const struct workqueue *wq;
+
+  printf ("Workqueue:");
+  for (wq = workqueues; wq < workqueues + WORK_PRI_CNT; wq++)
+    printf ("%s %lld %s items run (up to %d queued)",
+            wq == workqueues ? "" : ",", wq->run_cnt, wq->name,
+            wq->max_depth);
+  printf ("\n");
+}
+
+/* Initializes the workqueue for work priority WP, to be run by a
+   thread named NAME with the given PRIORITY. */
+static void
+init_workqueue (enum work_priority wp, const char *name, int priority) 
+{
+  struct workqueue *wq = &workqueues[wp];
+
+  wq->name = name;
+  wq->priority = priority;
+  list_init (&wq->items);
+  wq->thread = NULL;
+  wq->waiting = false;
+}
+
+/* Worker thread for workqueue WQ_. */
+static void
+worker (void *wq_) 
+{
+  struct workqueue *wq = wq_;
+
+  wq->thread = thread_current ();
+  for (;;) 
+    {
+      struct work *w;
+      enum intr_level old_level;
+
+      old_level = intr_disable ();
+      while (list_empty (&wq->items)) 
+        {
+          wq->waiting = true;
+          thread_block ();
+        }
+      w = list_entry (list_pop_front (&wq->items), struct work, elem);
+      w->queued = false;
+      wq->depth--;
+      intr_set_level (old_level);
+
+      w->func (w, w->aux);
+      wq->run_cnt++;
+    }
+}
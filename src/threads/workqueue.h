@@ -0,0 +1,38 @@
+#ifndef THREADS_WORKQUEUE_H
+#define THREADS_WORKQUEUE_H
+
+#include <list.h>
+#include <stdbool.h>
+
+/* Work priorities.  Each priority has its own worker thread, so
+   that a backlog at one priority cannot hold up another.  Only
+   I/O completion uses a workqueue so far. */
+enum work_priority
+  {
+    WORK_HIGH,                  /* I/O completion. */
+    WORK_PRI_CNT                /* Number of priorities. */
+  };
+
+struct work;
+typedef void work_func (struct work *, void *aux);
+
+/* A unit of work to be done later by a worker thread.  Owners
+   embed it in their own data structures, so queuing it never
+   needs to allocate memory and can be done from an interrupt
+   handler. */
+struct work
+  {
+    struct list_elem elem;      /* Workqueue list element. */
+    work_func *func;            /* Function to call. */
+    void *aux;                  /* Auxiliary data for FUNC. */
+    bool queued;                /* On a workqueue? */
+    enum work_priority priority; /* If queued, the workqueue's priority. */
+  };
+
+void workqueue_init (void);
+void work_init (struct work *, work_func *, void *aux);
+bool work_queue (struct work *, enum work_priority);
+bool work_cancel (struct work *);
+void workqueue_print_stats (void);
+
+#endif /* threads/workqueue.h */
@@ -220,6 +220,12 @@ sub assemble_disk {
 
 	my ($source);
 	my ($fn) = $p->{FILE};
+	if ($fn eq '/dev/zero') {
+	    # Empty partition: leave a hole instead of copying zeros,
+	    # so that even huge partitions take no space or time.
+	    write_zeros ($disk, $disk_fn, $p->{BYTES});
+	    next;
+	}
 	open ($source, '<', $fn) or die "$fn: open: $!\n";
 	if ($p->{OFFSET}) {
 	    sysseek ($source, $p->{OFFSET}, 0) == $p->{OFFSET}
@@ -234,6 +240,11 @@ sub assemble_disk {
 	my ($pad_sectors) = round_up ($total_sectors, cyl_sectors (%geometry));
 	write_zeros ($disk, $disk_fn, ($pad_sectors - $total_sectors) * 512);
     }
+
+    # Extend the disk over any trailing hole left by write_zeros().
+    my ($disk_size) = sysseek ($disk, 0, 1);
+    defined ($disk_size) && truncate ($disk, $disk_size)
+      or die "$disk_fn: truncate: $!\n";
     close ($disk) or die "$disk: close: $!\n";
 }
 
@@ -313,16 +324,17 @@ sub write_fully {
     die "$file_name: short write\n" if $written_bytes != length $data;
 }
 
+# write_zeros($handle, $file_name, $size)
+#
+# Skips over $size bytes of $handle, which must be a file open for
+# writing, leaving a hole that reads as zeros.  The file is not
+# extended until something is written after the hole or it is
+# truncated to its final size.  $file_name is used in error
+# messages.
 sub write_zeros {
     my ($handle, $file_name, $size) = @_;
 
-    while ($size > 0) {
-	my ($chunk_size) = 4096;
-	$chunk_size = $size if $chunk_size > $size;
-	$size -= $chunk_size;
-
-	write_fully ($handle, $file_name, "\0" x $chunk_size);
-    }
+    defined (sysseek ($handle, $size, 1)) or die "$file_name: seek: $!\n";
 }
 
 # div_round_up($x,$y)